@@ -105,8 +105,15 @@ class ADTNode:
         self._types = {}
         self._parent_path = path
         self._parent = parent
+        # Edit tracking, see edits(). _orig holds the raw value of every property as loaded.
+        self._orig = None
+        self._dirty = set()
+        self._deleted = []
+        self._restructured = False
 
         if val is not None:
+            self._orig = {p.name: p.value for p in val.properties}
+
             for p in val.properties:
                 if p.name == "name":
                     _name = p.value.decode("ascii").rstrip("\0")
@@ -154,20 +161,29 @@ class ADTNode:
                 self._children.append(value)
         else:
             self._children[item] = value
+        self._restructured = True
 
     def __delitem__(self, item):
         if isinstance(item, str):
             for i, c in enumerate(self._children):
                 if c.name == item:
-                    del self._children[i]
-                    return
-            raise KeyError(f"Child node '{item}' not found")
+                    break
+            else:
+                raise KeyError(f"Child node '{item}' not found")
+            item = i
 
+        child = self._children[item]
+        if child._orig is not None:
+            self._deleted.append(child.name)
         del self._children[item]
 
     def __getattr__(self, attr):
         attr = attr.replace("_", "-")
-        return self._properties[attr]
+        value = self._properties[attr]
+        # Parsed containers can be modified in place, so check them for changes later
+        if not isinstance(value, (int, float, str, bytes)):
+            self._dirty.add(attr)
+        return value
 
     def __setattr__(self, attr, value):
         if attr[0] == "_":
@@ -175,12 +191,15 @@ class ADTNode:
             return
         attr = attr.replace("_", "-")
         self._properties[attr] = value
+        self._dirty.add(attr)
 
     def __delattr__(self, attr):
         if attr[0] == "_":
             del self.__dict__[attr]
             return
+        attr = attr.replace("_", "-")
         del self._properties[attr]
+        self._dirty.add(attr)
 
     @property
     def address_cells(self):
@@ -225,10 +244,56 @@ class ADTNode:
 
         return addr, size
 
+    def _build_prop(self, k):
+        return build_prop(self._path, k, self._properties[k], t=self._types.get(k, None))
+
+    def edits(self):
+        """List the changes made since load_adt() or the last mark_clean().
+
+        Returns ("set", path, name, value), ("del_prop", path, name) and ("del_node", path)
+        tuples, with paths relative to the root as the target's ADT code expects them, or
+        None if nodes were added or replaced and the whole tree has to be rebuilt.
+        """
+        edits = []
+        if not self._collect_edits("/", edits):
+            return None
+        return edits
+
+    def _collect_edits(self, path, edits):
+        if self._orig is None or self._restructured:
+            return False
+
+        prefix = path.rstrip("/")
+        for name in self._deleted:
+            edits.append(("del_node", f"{prefix}/{name}"))
+
+        for k in self._dirty:
+            if k in self._properties:
+                value = self._build_prop(k)
+                if value != self._orig.get(k, None):
+                    edits.append(("set", path, k, value))
+            elif k in self._orig:
+                edits.append(("del_prop", path, k))
+
+        for c in self._children:
+            if not c._collect_edits(f"{prefix}/{c.name}", edits):
+                return False
+
+        return True
+
+    def mark_clean(self):
+        """Take the current state as the baseline for edits(), e.g. after pushing it."""
+        self._orig = {k: self._build_prop(k) for k in self._properties}
+        self._dirty = set()
+        self._deleted = []
+        self._restructured = False
+        for c in self._children:
+            c.mark_clean()
+
     def tostruct(self):
         properties = []
         for k,v in itertools.chain(self._properties.items()):
-            value = build_prop(self._path, k, v, t=self._types.get(k, None))
+            value = self._build_prop(k)
             properties.append({
                 "name": k,
                 "size": len(value),
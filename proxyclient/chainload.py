@@ -16,7 +16,7 @@ import asm
 
 macho = MachO(args.payload.read_bytes())
 
-image = macho.prepare_image()
+image_len = macho.image_size()
 
 new_base = u.base
 
@@ -29,7 +29,7 @@ if args.xnu:
 else:
     sepfw_start, sepfw_length = 0, 0
 
-image_size = align(len(image))
+image_size = align(image_len)
 sepfw_off = image_size
 image_size += align(sepfw_length)
 bootargs_off = image_size
@@ -39,9 +39,12 @@ image_size += bootargs_size
 print(f"Total region size: 0x{image_size:x} bytes")
 image_addr = u.malloc(image_size)
 
-print(f"Loading kernel image (0x{len(image):x} bytes)...")
-u.compressed_writemem(image_addr, image, True)
-p.dc_cvau(image_addr, len(image))
+print(f"Loading kernel image (0x{image_len:x} bytes)...")
+# Have m1n1 lay out the segments if it can, so only the file goes over the link
+if u.load_macho(macho, image_addr, image_len) is None:
+    image = macho.prepare_image()
+    u.compressed_writemem(image_addr, image, True)
+    p.dc_cvau(image_addr, len(image))
 
 if args.xnu:
     print(f"Copying SEPFW (0x{sepfw_length:x} bytes)...")
@@ -0,0 +1,121 @@
+#!/usr/bin/env python3
+# SPDX-License-Identifier: MIT
+"""Pty-backed stand-ins for m1n1 targets, to exercise host-side tools without hardware.
+
+Each target speaks the UART proxy protocol on its own pty: it answers NOP and the P_NOP and
+P_GET_BASE proxy calls, and rejects anything else as a bad command. A target is given a
+mode, which can also make it misbehave:
+
+    ok           answer every request
+    slow=SECS    answer every request after a delay
+    hang         read requests but never answer them
+    disconnect   close the link on the first request
+
+Run it with one mode per target; it prints the pty of each on one line and serves them until
+killed, e.g. for fleet.py --no-bootstrap:
+
+    python3 fake_target.py ok ok hang
+"""
+
+import os, sys, pty, tty, struct, threading, time
+from proxy import UartInterface, M1N1Proxy
+
+# What P_GET_BASE returns
+FAKE_BASE = 0x800000000
+
+def _checksum(data):
+    # Same as UartInterface.checksum()
+    sum = 0xDEADBEEF
+    for c in data:
+        sum = (sum * 31337 + (c ^ 0x5a)) & 0xFFFFFFFF
+    return sum ^ 0xADDEDBAD
+
+class FakeTarget:
+    CMD_SIZE = 4 + UartInterface.CMD_LEN + 4
+
+    def __init__(self, mode="ok"):
+        self.mode, _, arg = mode.partition("=")
+        if self.mode not in ("ok", "slow", "hang", "disconnect"):
+            raise ValueError(f"Unknown mode {mode!r}")
+        self.delay = float(arg) if self.mode == "slow" else 0
+        self.master, self.slave = pty.openpty()
+        # Keep the slave open too, so the pty outlives clients that come and go
+        tty.setraw(self.slave)
+        self.path = os.ttyname(self.slave)
+        self.thread = threading.Thread(target=self._serve, daemon=True)
+        self.thread.start()
+
+    def close(self):
+        for fd in (self.master, self.slave):
+            try:
+                os.close(fd)
+            except OSError:
+                pass
+
+    def _reply(self, typ, status, data=b""):
+        reply = struct.pack("<Ii24s", typ, status, data)
+        os.write(self.master, reply + struct.pack("<I", _checksum(reply)))
+
+    def _handle(self, cmd):
+        typ, = struct.unpack_from("<I", cmd)
+        if self.mode == "hang":
+            return
+        if self.mode == "disconnect":
+            self.close()
+            raise EOFError()
+        time.sleep(self.delay)
+
+        if typ == UartInterface.REQ_NOP:
+            self._reply(typ, UartInterface.ST_OK)
+        elif typ == UartInterface.REQ_PROXY:
+            opcode, = struct.unpack_from("<Q", cmd, 4)
+            retvals = {M1N1Proxy.P_NOP: 0, M1N1Proxy.P_GET_BASE: FAKE_BASE}
+            if opcode in retvals:
+                data = struct.pack("<QqQ", opcode, M1N1Proxy.S_OK, retvals[opcode])
+            else:
+                data = struct.pack("<QqQ", opcode, M1N1Proxy.S_BADCMD, 0)
+            self._reply(typ, UartInterface.ST_OK, data)
+        else:
+            self._reply(typ, UartInterface.ST_BADCMD)
+
+    def _serve(self):
+        buf = b""
+        while True:
+            try:
+                data = os.read(self.master, 4096)
+            except OSError:
+                return
+            if not data:
+                return
+            buf += data
+
+            # Requests start with a "\xff\x55\xaa" + type byte word, anything else is noise
+            while True:
+                i = buf.find(b"\xff\x55\xaa")
+                if i < 0:
+                    buf = buf[-2:]
+                    break
+                if len(buf) - i < self.CMD_SIZE:
+                    buf = buf[i:]
+                    break
+                cmd, buf = buf[i:i + self.CMD_SIZE], buf[i + self.CMD_SIZE:]
+                checksum, = struct.unpack_from("<I", cmd, self.CMD_SIZE - 4)
+                if checksum != _checksum(cmd[:-4]):
+                    continue
+                try:
+                    self._handle(cmd)
+                except (EOFError, OSError):
+                    return
+
+if __name__ == "__main__":
+    if len(sys.argv) < 2:
+        print(f"usage: {sys.argv[0]} mode...", file=sys.stderr)
+        sys.exit(2)
+
+    targets = [FakeTarget(mode) for mode in sys.argv[1:]]
+    print(" ".join(t.path for t in targets), flush=True)
+    try:
+        while True:
+            time.sleep(3600)
+    except KeyboardInterrupt:
+        pass
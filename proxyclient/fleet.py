@@ -0,0 +1,251 @@
+#!/usr/bin/env python3
+# SPDX-License-Identifier: MIT
+"""Run the same script against many m1n1 targets at once.
+
+Each target gets its own worker process, so a slow or wedged link can be killed on timeout
+without holding up the others, and the Python-side protocol work (checksums, compression)
+runs in parallel. A script is a Python file defining run(ctx); ctx carries the target name,
+the UartInterface and M1N1Proxy for it, and a lazily created ProxyUtils:
+
+    def run(ctx):
+        return hex(ctx.p.get_base())
+
+Whatever run() returns (if picklable) ends up in the results; anything it prints goes to
+the per-target log. Targets are given as [name=]device[:baud], the same device syntax as
+M1N1DEVICE, so pty stand-ins (see fake_target.py) work like any other serial port (use
+--no-bootstrap there).
+"""
+
+import os, sys, time, json, runpy, traceback, multiprocessing, multiprocessing.connection
+from collections import deque
+
+class Target:
+    def __init__(self, spec):
+        if "=" in spec:
+            self.name, self.device = spec.split("=", 1)
+        else:
+            self.device = spec
+            self.name = os.path.basename(spec.rsplit(":", 1)[0])
+
+    def __repr__(self):
+        return f"Target({self.name}={self.device})"
+
+class Result:
+    def __init__(self, target):
+        self.target = target
+        self.ok = False
+        self.value = None
+        self.error = None
+        self.attempts = 0
+        self.elapsed = 0
+        self.log = None
+
+    def to_json(self):
+        value = self.value
+        try:
+            json.dumps(value)
+        except TypeError:
+            value = repr(value)
+        return {
+            "name": self.target.name,
+            "device": self.target.device,
+            "ok": self.ok,
+            "value": value,
+            "error": self.error,
+            "attempts": self.attempts,
+            "elapsed": round(self.elapsed, 3),
+            "log": self.log,
+        }
+
+class FleetContext:
+    def __init__(self, target, iface, p):
+        self.target = target
+        self.name = target.name
+        self.iface = iface
+        self.p = p
+        self._u = None
+
+    @property
+    def u(self):
+        if self._u is None:
+            from proxyutils import ProxyUtils
+            self._u = ProxyUtils(self.p)
+        return self._u
+
+def _load_func(func):
+    if callable(func):
+        return func
+    path, _, name = func.partition(":")
+    return runpy.run_path(path)[name or "run"]
+
+def _worker(target, func, conn, log, bootstrap, attempt):
+    fd = os.open(log, os.O_WRONLY | os.O_CREAT | os.O_APPEND, 0o644)
+    os.dup2(fd, 1)
+    os.dup2(fd, 2)
+    os.close(fd)
+    sys.stdout = os.fdopen(1, "w", buffering=1)
+    sys.stderr = sys.stdout
+    print(f"=== {target.name} ({target.device}), attempt {attempt} at {time.ctime()}")
+
+    try:
+        from proxy import UartInterface, M1N1Proxy
+        from proxyutils import bootstrap_port
+
+        iface = UartInterface(target.device)
+        p = M1N1Proxy(iface)
+        if bootstrap:
+            bootstrap_port(iface, p)
+        ret = _load_func(func)(FleetContext(target, iface, p))
+        try:
+            conn.send((True, ret))
+        except Exception:
+            conn.send((True, repr(ret)))
+    except BaseException as e:
+        traceback.print_exc()
+        conn.send((False, f"{type(e).__name__}: {e}"))
+    finally:
+        sys.stdout.flush()
+        conn.close()
+
+class Fleet:
+    """Schedule a script across targets with bounded parallelism, timeouts and retries.
+
+    func is either a callable (requires the fork start method) or "path.py[:function]",
+    which each worker loads for itself.
+    """
+    def __init__(self, targets, parallel=None, timeout=None, retries=0, log_dir=None,
+                 bootstrap=True, verbose=True):
+        self.targets = [t if isinstance(t, Target) else Target(t) for t in targets]
+        names = [t.name for t in self.targets]
+        if len(set(names)) != len(names):
+            raise ValueError("Duplicate target names, use name=device to disambiguate")
+        self.parallel = parallel or len(self.targets)
+        self.timeout = timeout
+        self.retries = retries
+        self.bootstrap = bootstrap
+        self.verbose = verbose
+        if log_dir is None:
+            log_dir = os.path.join("fleet-logs", time.strftime("%Y%m%d-%H%M%S"))
+        self.log_dir = log_dir
+
+    def _status(self, msg):
+        if self.verbose:
+            print(f"[{time.strftime('%H:%M:%S')}] {msg}", flush=True)
+
+    def run(self, func):
+        os.makedirs(self.log_dir, exist_ok=True)
+        results = {t.name: Result(t) for t in self.targets}
+        pending = deque(self.targets)
+        running = {}
+
+        while pending or running:
+            while pending and len(running) < self.parallel:
+                target = pending.popleft()
+                res = results[target.name]
+                res.attempts += 1
+                res.log = os.path.join(self.log_dir, f"{target.name}.log")
+                rx, tx = multiprocessing.Pipe(duplex=False)
+                proc = multiprocessing.Process(
+                    target=_worker, name=f"fleet-{target.name}",
+                    args=(target, func, tx, res.log, self.bootstrap, res.attempts))
+                proc.start()
+                tx.close()
+                running[target.name] = (proc, rx, time.time())
+
+            ready = multiprocessing.connection.wait(
+                [rx for proc, rx, start in running.values()] +
+                [proc.sentinel for proc, rx, start in running.values()], timeout=0.1)
+
+            for name, (proc, rx, start) in list(running.items()):
+                res = results[name]
+                done = False
+                if rx in ready or proc.sentinel in ready:
+                    try:
+                        res.ok, val = rx.recv()
+                        if res.ok:
+                            res.value, res.error = val, None
+                        else:
+                            res.error = val
+                    except EOFError:
+                        res.ok = False
+                        res.error = f"worker died (exit code {proc.exitcode})"
+                    done = True
+                elif self.timeout and time.time() - start > self.timeout:
+                    proc.terminate()
+                    res.ok = False
+                    res.error = f"timed out after {self.timeout}s"
+                    done = True
+
+                if not done:
+                    continue
+
+                proc.join(1)
+                if proc.is_alive():
+                    proc.kill()
+                    proc.join()
+                rx.close()
+                res.elapsed += time.time() - start
+                del running[name]
+
+                if res.ok:
+                    self._status(f"{name}: ok ({res.elapsed:.1f}s)")
+                elif res.attempts <= self.retries:
+                    self._status(f"{name}: {res.error}, retrying")
+                    pending.append(res.target)
+                else:
+                    self._status(f"{name}: FAILED: {res.error}")
+
+        return [results[t.name] for t in self.targets]
+
+def print_summary(results):
+    w = max([len(r.target.name) for r in results] + [4])
+    print()
+    print(f"{'name':{w}}  status  tries  time     result")
+    for r in results:
+        status = "ok" if r.ok else "FAIL"
+        detail = r.value if r.ok else r.error
+        print(f"{r.target.name:{w}}  {status:6}  {r.attempts:5}  {r.elapsed:6.1f}s  {detail}")
+    failed = sum(not r.ok for r in results)
+    print(f"\n{len(results) - failed}/{len(results)} targets succeeded")
+
+if __name__ == "__main__":
+    import argparse
+
+    parser = argparse.ArgumentParser(description="Run a proxyclient script on many targets")
+    parser.add_argument("-t", "--target", action="append", default=[],
+                        help="[name=]device[:baud], may be repeated")
+    parser.add_argument("-T", "--targets-file",
+                        help="file with one target per line (# comments allowed)")
+    parser.add_argument("-j", "--parallel", type=int, default=None,
+                        help="max targets in flight (default: all)")
+    parser.add_argument("--timeout", type=float, default=None,
+                        help="per-attempt timeout in seconds")
+    parser.add_argument("-r", "--retries", type=int, default=0)
+    parser.add_argument("-l", "--log-dir", default=None)
+    parser.add_argument("-o", "--output", help="write results as JSON")
+    parser.add_argument("--no-bootstrap", action="store_true",
+                        help="skip link negotiation (e.g. for pty stand-ins)")
+    parser.add_argument("script", help="script.py[:function], function defaults to run")
+    args = parser.parse_args()
+
+    targets = list(args.target)
+    if args.targets_file:
+        with open(args.targets_file) as fd:
+            for line in fd:
+                line = line.split("#", 1)[0].strip()
+                if line:
+                    targets.append(line)
+    if not targets:
+        parser.error("no targets given")
+
+    fleet = Fleet(targets, parallel=args.parallel, timeout=args.timeout, retries=args.retries,
+                  log_dir=args.log_dir, bootstrap=not args.no_bootstrap)
+    print(f"Running {args.script} on {len(fleet.targets)} targets, logs in {fleet.log_dir}")
+    results = fleet.run(os.path.abspath(args.script))
+    print_summary(results)
+
+    if args.output:
+        with open(args.output, "w") as fd:
+            json.dump([r.to_json() for r in results], fd, indent=1)
+
+    sys.exit(0 if all(r.ok for r in results) else 1)
@@ -0,0 +1,86 @@
+#!/usr/bin/env python3
+# SPDX-License-Identifier: MIT
+"""Check fleet.py against several fake targets at once (see fake_target.py): a healthy one,
+slow ones that must run in parallel, one that hangs and must be timed out, and one that drops
+the link and must fail on its own. Every failing target is retried once. Run by
+`make host-test`.
+"""
+
+import os, sys, subprocess, tempfile, time
+from fleet import Fleet
+from fake_target import FAKE_BASE
+
+TIMEOUT = 2
+# Two requests per run, so each slow target takes 1.5s
+SLOW = 0.75
+
+SCRIPT = """
+def run(ctx):
+    ctx.p.nop()
+    return hex(ctx.p.get_base())
+"""
+
+TARGETS = {
+    "fast": "ok",
+    "slow0": f"slow={SLOW}",
+    "slow1": f"slow={SLOW}",
+    "slow2": f"slow={SLOW}",
+    "hang": "hang",
+    "gone": "disconnect",
+}
+
+checks = failures = 0
+
+def check(ok, what):
+    global checks, failures
+    checks += 1
+    if not ok:
+        failures += 1
+        print(f"FAIL: {what}")
+
+def main():
+    here = os.path.dirname(os.path.abspath(__file__))
+    # A process of their own, so the fleet's forked workers do not inherit the pty masters
+    server = subprocess.Popen([sys.executable, os.path.join(here, "fake_target.py"),
+                               *TARGETS.values()], stdout=subprocess.PIPE, text=True)
+    try:
+        paths = server.stdout.readline().split()
+        if len(paths) != len(TARGETS):
+            check(False, "fake targets did not start")
+            return
+
+        with tempfile.TemporaryDirectory() as tmp:
+            script = os.path.join(tmp, "script.py")
+            with open(script, "w") as fd:
+                fd.write(SCRIPT)
+
+            fleet = Fleet([f"{name}={path}" for name, path in zip(TARGETS, paths)],
+                          timeout=TIMEOUT, retries=1, log_dir=os.path.join(tmp, "logs"),
+                          bootstrap=False, verbose=False)
+            start = time.time()
+            results = {r.target.name: r for r in fleet.run(script)}
+            elapsed = time.time() - start
+    finally:
+        server.terminate()
+        server.wait()
+
+    for name in ("fast", "slow0", "slow1", "slow2"):
+        r = results[name]
+        check(r.ok and r.value == hex(FAKE_BASE) and r.attempts == 1,
+              f"{name}: ok={r.ok} value={r.value} error={r.error} attempts={r.attempts}")
+
+    r = results["hang"]
+    check(not r.ok and "timed out" in r.error and r.attempts == 2,
+          f"hang: ok={r.ok} error={r.error} attempts={r.attempts}")
+
+    r = results["gone"]
+    check(not r.ok and "timed out" not in r.error and r.attempts == 2,
+          f"gone: ok={r.ok} error={r.error} attempts={r.attempts}")
+
+    # Both attempts on the hung target bound the run; one at a time would take far longer
+    check(elapsed < 2 * TIMEOUT + 1.5, f"took {elapsed:.1f}s, targets did not run in parallel")
+
+if __name__ == "__main__":
+    main()
+    print(f"fleet_test: {checks} checks, {failures} failures")
+    sys.exit(1 if failures else 0)
@@ -1,17 +1,18 @@
 #!/usr/bin/env python3
 # SPDX-License-Identifier: MIT
 
-import sys, traceback, struct, array, bisect, os
+import sys, traceback, struct, array, bisect, os, contextlib
 
 from construct import *
 
 from asm import ARMAsm
 from tgtypes import *
-from proxy import IODEV, START, EVENT, EXC, EXC_RET, ExcInfo
+from proxy import IODEV, START, EVENT, EXC, EXC_RET, FEAT, ExcInfo
 from utils import *
 from sysreg import *
 from macho import MachO
 from adt import load_adt
+from timeline import TraceSink
 import xnutools
 import shell
 
@@ -20,23 +21,76 @@ PAC_MASK = 0xfffff00000000000
 class MMIOTraceFlags(Register32):
     WIDTH = 2, 0
     WRITE = 3
+    KEYFRAME = 4
+    SAME_PC = 5
+    TIME = 6
 
-EvtMMIOTrace = Struct(
+EvtMMIOTrace = FastStruct(Struct(
     "flags" / RegAdapter(MMIOTraceFlags),
     "reserved" / Int32ul,
     "pc" / Hex(Int64ul),
     "addr" / Hex(Int64ul),
     "data" / Hex(Int64ul),
-)
+))
+
+def _read_varint(data, off):
+    val = shift = 0
+    while True:
+        b = data[off]
+        off += 1
+        val |= (b & 0x7f) << shift
+        shift += 7
+        if not b & 0x80:
+            break
+    return (val >> 1) ^ -(val & 1), off
+
+def decode_mmiotrace_delta(data):
+    """Decode an EVT_MMIOTRACE_DELTA payload (see hv.h) into
+    (pc, addr, data, write, width, time) tuples. width is log2 of the access size in bytes, and
+    time the target CNTPCT_EL0 value, or None if the record has no timestamp."""
+    mask = (1 << 64) - 1
+    off = pc = addr = time = 0
+    while off < len(data):
+        flags = MMIOTraceFlags(data[off])
+        off += 1
+        if flags.KEYFRAME:
+            pc, addr = struct.unpack_from("<QQ", data, off)
+            off += 16
+            if flags.TIME:
+                time, = struct.unpack_from("<Q", data, off)
+                off += 8
+        else:
+            if not flags.SAME_PC:
+                delta, off = _read_varint(data, off)
+                pc = (pc + (delta << 2)) & mask
+            delta, off = _read_varint(data, off)
+            addr = (addr + delta) & mask
+            if flags.TIME:
+                delta, off = _read_varint(data, off)
+                time = (time + delta) & mask
+        width = flags.WIDTH
+        val = int.from_bytes(data[off:off + (1 << width)], "little")
+        off += 1 << width
+        yield pc, addr, val, bool(flags.WRITE), width, time if flags.TIME else None
 
 class HOOK(IntEnum):
     VM = 1
 
-VMProxyHookData = Struct(
+# hvc immediate for the paravirtual console: x0 = buffer, x1 = length
+HVC_PVCON = 0x4d31
+
+VMProxyHookData = FastStruct(Struct(
     "flags" / RegAdapter(MMIOTraceFlags),
     "id" / Int32ul,
     "addr" / Hex(Int64ul),
     "data" / Hex(Int64ul),
+))
+
+HVTimeCompStats = Struct(
+    "exits" / Int64ul,
+    "capped" / Int64ul,
+    "total" / Int64ul,
+    "max" / Int64ul,
 )
 
 class HV:
@@ -94,6 +148,9 @@ class HV:
         self.symbols = []
         self.sysreg = {}
         self.vm_hooks = []
+        self.exit_data = 0
+        self.pending_reload = None
+        self.trace = None
 
     def unmap(self, ipa, size):
         assert self.p.hv_map(ipa, 0, size, 0) >= 0
@@ -119,6 +176,17 @@ class HV:
         self.vm_hooks.append((read, write, ipa, kwargs))
         assert self.p.hv_map(ipa, (index << 2) | t, size, 1) >= 0
 
+    def set_time_comp(self, enable=True, cap_ms=100):
+        """Hide time spent outside the guest from its virtual counter, at most cap_ms per exit"""
+        self.p.hv_set_time_comp(enable, int(cap_ms * 1000))
+
+    def time_comp_stats(self):
+        stats = self.iface.readstruct(self.p.hv_get_time_comp_stats(), HVTimeCompStats)
+        freq = self.u.mrs(CNTFRQ_EL0)
+        print(f"Time compensation: {stats.exits} exits, {stats.capped} capped, "
+              f"{stats.total / freq:.3f}s hidden, longest stall {stats.max * 1000 / freq:.3f}ms")
+        return stats
+
     def addr(self, addr):
         unslid_addr = addr + self.sym_offset
         if addr < self.tba.virt_base or unslid_addr < self.macho.vmin:
@@ -144,25 +212,51 @@ class HV:
 
         return self.symbols[idx]
 
+    def trace_to(self, path):
+        """Record MMIO traces, guest exits and boot stages to a trace file (see timeline.py)
+        instead of printing MMIO traces. Pass None to stop."""
+        if self.trace is not None:
+            self.trace.close()
+            self.trace = None
+        if path is not None:
+            self.trace = TraceSink(path, adt=self.adt, u=self.u)
+        # Timestamps on MMIO records and hook exits only pay off when there is a timeline
+        features = self.iface.features
+        if features is None or features & FEAT.TRACE_TIME:
+            self.p.hv_set_trace_time(path is not None)
+
+    def stage(self, name):
+        """Context manager timing a boot stage in the trace, if there is one"""
+        if self.trace is None:
+            return contextlib.nullcontext()
+        return self.trace.span(name, "boot")
+
+    def log_mmiotrace(self, pc, addr, data, write, width=3, time=None):
+        if self.trace is not None:
+            self.trace.mmio(time, pc, addr, data, width, write)
+            return
+        t = "W" if write else "R"
+        print(f"[0x{pc:016x}] MMIO: {t} 0x{addr:x} = 0x{data:x}")
+
     def handle_mmiotrace(self, data):
         evt = EvtMMIOTrace.parse(data)
-        if evt.flags.WRITE:
-            t = "W"
-        else:
-            t = "R"
+        self.log_mmiotrace(evt.pc, evt.addr, evt.data, evt.flags.WRITE, evt.flags.WIDTH)
 
-        print(f"[0x{evt.pc:016x}] MMIO: {t} 0x{evt.addr:x} = 0x{evt.data:x}")
+    def handle_mmiotrace_delta(self, data):
+        for pc, addr, val, write, width, time in decode_mmiotrace_delta(data):
+            self.log_mmiotrace(pc, addr, val, write, width, time)
 
-    def handle_vm_hook(self, ctx):
-        data = self.iface.readstruct(ctx.data, VMProxyHookData)
+    def handle_pvcon(self, data):
+        sys.stdout.write(data.decode("utf-8", errors="replace"))
+        sys.stdout.flush()
 
+    def handle_vm_hook(self, data):
         rfunc, wfunc, base, kwargs = self.vm_hooks[data.id]
 
         if data.flags.WRITE:
             wfunc(base, data.addr - base, data.data, 1 << data.flags.WIDTH, **kwargs)
         else:
-            val = rfunc(base, data.addr - base, 1 << data.flags.WIDTH, **kwargs)
-            self.p.write64(ctx.data + 16, val)
+            self.exit_data = rfunc(base, data.addr - base, 1 << data.flags.WIDTH, **kwargs)
 
         return True
 
@@ -323,10 +417,36 @@ class HV:
         if ctx.esr.EC == ESR_EC.HVC:
             return self.handle_hvc(ctx)
 
-    def handle_exception(self, reason, code, info):
+    def handle_exception(self, reason, code, info, inline=None):
+        self.exit_data = 0
+
+        if reason == START.HV_HOOK:
+            # Hook data comes inline with the exit and read values go back with P_EXIT,
+            # so unless the hook fails we never need to touch the exception context.
+            code = HOOK(code)
+            if self.trace is not None:
+                # The exit time follows the hook data while trace timestamps are on
+                time = None
+                if len(inline) >= VMProxyHookData.sizeof() + 8:
+                    time, = struct.unpack_from("<Q", inline, VMProxyHookData.sizeof())
+                self.trace.begin("guest exits", f"hook {code.name}", time)
+            try:
+                if code == HOOK.VM and self.handle_vm_hook(VMProxyHookData.parse(inline)):
+                    if self.trace is not None:
+                        self.trace.end("guest exits")
+                    self.p.exit(EXC_RET.STEP if self.step else EXC_RET.HANDLED, self.exit_data)
+                    return
+            except Exception as e:
+                print(f"Python exception while handling guest exception:")
+                traceback.print_exc()
+
         info_data = self.iface.readmem(info, ExcInfo.sizeof())
         self.ctx = ctx = ExcInfo.parse(info_data)
 
+        # Hooks that fell through are already being timed from when we got them
+        if self.trace is not None and reason != START.HV_HOOK:
+            self.trace.begin("guest exits", f"{reason.name}/{code.name}", ctx.time)
+
         handled = False
 
         try:
@@ -337,10 +457,6 @@ class HV:
                     self.u.msr(CNTV_CTL_EL0, 0)
                     self.u.print_exception(code, ctx)
                     handled = True
-            elif reason == START.HV_HOOK:
-                code = HOOK(code)
-                if code == HOOK.VM:
-                    handled = self.handle_vm_hook(ctx)
         except Exception as e:
             print(f"Python exception while handling guest exception:")
             traceback.print_exc()
@@ -375,7 +491,9 @@ class HV:
 
         if ret == EXC_RET.HANDLED and self.step:
             ret = EXC_RET.STEP
-        self.p.exit(ret)
+        if self.trace is not None:
+            self.trace.end("guest exits")
+        self.p.exit(ret, self.exit_data)
 
     def skip(self):
         self.ctx.elr += 4
@@ -476,7 +594,8 @@ class HV:
         self.vbar_el1 = vbar
 
     def init(self):
-        self.adt = load_adt(self.u.get_adt())
+        self.adt_data = self.u.get_adt()
+        self.adt = load_adt(self.adt_data)
         self.iodev = self.p.iodev_whoami()
         self.tba = self.u.ba.copy()
 
@@ -489,6 +608,8 @@ class HV:
         self.iface.set_handler(START.EXCEPTION_LOWER, EXC.SERROR, self.handle_exception)
         self.iface.set_handler(START.HV_HOOK, HOOK.VM, self.handle_exception)
         self.iface.set_event_handler(EVENT.MMIOTRACE, self.handle_mmiotrace)
+        self.iface.set_event_handler(EVENT.MMIOTRACE_DELTA, self.handle_mmiotrace_delta)
+        self.iface.set_event_handler(EVENT.PVCON, self.handle_pvcon)
 
         self.map_hw(0x2_00000000, 0x2_00000000, 0x5_00000000)
 
@@ -562,12 +683,7 @@ class HV:
         print(f"Setting boot arguments to {boot_args!r}")
         self.tba.cmdline = boot_args
 
-    def load_macho(self, data, symfile=None):
-        if isinstance(data, str):
-            data = open(data, "rb")
-
-        self.macho = macho = MachO(data)
-        symbols = None
+    def load_symbols(self, macho, symfile=None):
         if symfile is not None:
             if isinstance(symfile, str):
                 symfile = open(symfile, "rb")
@@ -577,6 +693,20 @@ class HV:
         self.symbols = [(v, k) for k, v in macho.symbols.items()]
         self.symbols.sort()
 
+    def keep_pristine(self, addr, size):
+        """Keep a copy of a guest memory range on the target, to be restored on reload"""
+        copy = self.u.malloc(size)
+        self.p.memcpy8(copy, addr, size)
+        self.pristine.append((addr, copy, size))
+        return copy
+
+    def load_macho(self, data, symfile=None):
+        if isinstance(data, str):
+            data = open(data, "rb")
+
+        self.macho = macho = MachO(data)
+        self.load_symbols(macho, symfile)
+
         def load_hook(data, segname, size, fileoff, dest):
             if segname != "__TEXT_EXEC":
                 return data
@@ -605,11 +735,11 @@ class HV:
             return a.tobytes()
 
         #image = macho.prepare_image(load_hook)
-        image = macho.prepare_image()
+        image_len = macho.image_size()
         sepfw_start, sepfw_length = self.u.adt["chosen"]["memory-map"].SEPFW
         tc_start, tc_size = self.u.adt["chosen"]["memory-map"].TrustCache
 
-        image_size = align(len(image))
+        image_size = align(image_len)
         sepfw_off = image_size
         image_size += align(sepfw_length)
         self.bootargs_off = image_size
@@ -636,16 +766,33 @@ class HV:
         print(f"Mapping guest physical memory...")
         self.map_hw(phys_base, phys_base, self.u.ba.mem_size_actual - phys_base + 0x800000000)
 
-        print(f"Loading kernel image (0x{len(image):x} bytes)...")
-        self.u.compressed_writemem(guest_base, image, True)
-        self.p.dc_cvau(guest_base, len(image))
-        self.p.ic_ivau(guest_base, len(image))
-
-        print(f"Copying SEPFW (0x{sepfw_length:x} bytes)...")
-        self.p.memcpy8(guest_base + sepfw_off, sepfw_start, sepfw_length)
-
-        print(f"Copying TrustCache (0x{tc_size:x} bytes)...")
-        self.p.memcpy8(tc_base, tc_start, tc_size)
+        print(f"Loading kernel image (0x{image_len:x} bytes)...")
+        image = None
+        with self.stage("load kernel"):
+            # Have m1n1 lay out the segments if it can, so only the file goes over the link
+            if self.u.load_macho(macho, guest_base, image_len) is None:
+                image = macho.prepare_image()
+                self.u.compressed_writemem(guest_base, image, True)
+                self.p.dc_cvau(guest_base, len(image))
+                self.p.ic_ivau(guest_base, len(image))
+
+        self.pristine = []
+        # The host-side image is only built when needed, see reset_guest()
+        self.image = image
+        self.image_len = image_len
+        self.image_copy = self.keep_pristine(guest_base, sepfw_off)
+
+        with self.stage("copy firmware"):
+            print(f"Copying SEPFW (0x{sepfw_length:x} bytes)...")
+            self.p.memcpy8(guest_base + sepfw_off, sepfw_start, sepfw_length)
+
+            print(f"Copying TrustCache (0x{tc_size:x} bytes)...")
+            self.p.memcpy8(tc_base, tc_start, tc_size)
+
+        self.firmware_copies = [
+            (guest_base + sepfw_off, sepfw_start, sepfw_length),
+            (tc_base, tc_start, tc_size),
+        ]
 
         print(f"Adjusting addresses in ADT...")
         self.adt["chosen"]["memory-map"].SEPFW = (guest_base + sepfw_off, sepfw_length)
@@ -653,9 +800,22 @@ class HV:
         self.adt["chosen"]["memory-map"].DeviceTree = (adt_base, align(self.u.ba.devtree_size))
         self.adt["chosen"]["memory-map"].BootArgs = (guest_base + self.bootargs_off, bootargs_size)
 
-        adt_blob = self.adt.build()
-        print(f"Uploading ADT (0x{len(adt_blob):x} bytes)...")
-        self.iface.writemem(adt_base, adt_blob)
+        # If m1n1's ADT is still the one self.adt was loaded from, copy it and patch that
+        adt_size = None
+        with self.stage("ADT"):
+            if self.u.adt_data is self.adt_data:
+                print(f"Copying ADT (0x{self.u.ba.devtree_size:x} bytes)...")
+                self.p.memcpy8(adt_base,
+                               self.u.ba.devtree - self.u.ba.virt_base + self.u.ba.phys_base,
+                               self.u.ba.devtree_size)
+                adt_size = self.u.patch_adt(adt_base, align(self.u.ba.devtree_size),
+                                            self.adt.edits())
+            if adt_size is None:
+                adt_blob = self.adt.build()
+                adt_size = len(adt_blob)
+                print(f"Uploading ADT (0x{adt_size:x} bytes)...")
+                self.iface.writemem(adt_base, adt_blob)
+            self.keep_pristine(adt_base, adt_size)
 
         print(f"Setting up bootargs at 0x{guest_base + self.bootargs_off:x}...")
 
@@ -668,6 +828,67 @@ class HV:
         self.sym_offset = macho.vmin - guest_base + self.tba.phys_base - self.tba.virt_base
 
         self.iface.writemem(guest_base + self.bootargs_off, BootArgs.build(self.tba))
+        self.keep_pristine(guest_base + self.bootargs_off, BootArgs.sizeof())
+
+    def reload(self, data=None, symfile=None):
+        """Restart the guest from the debug shell, optionally with a new kernel image"""
+        self.pending_reload = (data, symfile)
+        raise shell.ExitConsole(EXC_RET.EXIT_GUEST)
+
+    def upload_delta(self, base, old, new, block=0x10000):
+        runs = []
+        for off in range(0, len(new), block):
+            end = min(off + block, len(new))
+            if new[off:end] == old[off:end]:
+                continue
+            if runs and runs[-1][1] == off:
+                runs[-1][1] = end
+            else:
+                runs.append([off, end])
+
+        for start, end in runs:
+            self.u.compressed_writemem(base + start, new[start:end], False)
+
+        changed = sum(end - start for start, end in runs)
+        print(f"Uploaded 0x{changed:x} of 0x{len(new):x} bytes in {len(runs)} runs")
+
+    def reset_guest(self, data=None, symfile=None):
+        if data is not None:
+            if isinstance(data, str):
+                data = open(data, "rb")
+            macho = MachO(data)
+            if macho.vmin != self.macho.vmin:
+                raise Exception("New kernel has a different base address, a full reload is needed")
+            image = macho.prepare_image()
+            if len(image) > self.image_len:
+                raise Exception("New kernel does not fit in the guest region, a full reload is needed")
+
+            print(f"Updating kernel image...")
+            old = self.image
+            if old is None:
+                old = self.macho.prepare_image()
+            old = bytes(old) + bytes(self.image_len - len(old))
+            image = bytes(image) + bytes(self.image_len - len(image))
+            self.upload_delta(self.image_copy, old, image)
+            self.image = image
+            self.macho = macho
+            self.entry = macho.entry - macho.vmin + self.guest_base
+            self.load_symbols(macho, symfile)
+
+        print(f"Restoring guest memory...")
+        for addr, copy, size in self.pristine:
+            self.p.memcpy8(addr, copy, size)
+        for addr, src, size in self.firmware_copies:
+            self.p.memcpy8(addr, src, size)
+        self.p.dc_cvau(self.guest_base, self.image_len)
+        self.p.ic_ivau(self.guest_base, self.image_len)
+
+        print(f"Resetting vCPU...")
+        self.p.hv_reset_vcpu()
+        self.vbar_el1 = None
+        self.want_vbar = None
+        self.vectors = [None]
+        self.sysreg = {}
 
     def start(self):
         print(f"Disabling other iodevs...")
@@ -685,9 +906,21 @@ class HV:
         print(f"Enabling GXF...")
         self.u.msr(GXF_CONFIG_EL1, 1)
 
-        print(f"Jumping to entrypoint at 0x{self.entry:x}")
-
         self.iface.dev.timeout = None
 
-        # Does not return
-        self.p.hv_start(self.entry, self.guest_base + self.bootargs_off)
+        while True:
+            print(f"Jumping to entrypoint at 0x{self.entry:x}")
+
+            self.pending_reload = None
+            if self.trace is not None:
+                self.trace.instant("boot", "guest entry")
+            # Only returns if the guest is exited
+            self.p.hv_start(self.entry, self.guest_base + self.bootargs_off)
+
+            if self.pending_reload is None:
+                break
+
+            self.reset_guest(*self.pending_reload)
+
+        if self.trace is not None:
+            self.trace_to(None)
@@ -0,0 +1,55 @@
+#!/usr/bin/env python3
+# SPDX-License-Identifier: MIT
+
+# Runs a tiny guest under the hypervisor that prints through the paravirtual console
+
+import argparse
+
+parser = argparse.ArgumentParser(description='Paravirtual console test guest')
+parser.add_argument('-n', '--lines', type=int, default=100)
+args = parser.parse_args()
+
+from setup import *
+from hv import HVC_PVCON
+import asm
+
+hv.init()
+
+page = u.memalign(0x4000, 0x4000)
+msg = b"Hello from the guest, over the paravirtual console!\n"
+msg_asm = msg.decode("ascii").replace("\n", "\\n")
+
+guest = asm.ARMAsm(f"""
+        ldr x19, ={args.lines}
+1:
+        adr x0, msg
+        mov x1, #{len(msg)}
+        hvc #{HVC_PVCON}
+        sub x19, x19, #1
+        cbnz x19, 1b
+        brk #0
+msg:
+        .ascii "{msg_asm}"
+""", page)
+
+iface.writemem(page, guest.data)
+p.dc_cvau(page, guest.len)
+p.ic_ivau(page, guest.len)
+
+hv.map_hw(page, page, 0x4000)
+p.hv_set_pvcon()
+
+def guest_done(reason, code, info, inline):
+    # The guest ends with a brk, which lands here; leave the hypervisor
+    p.exit(EXC_RET.EXIT_GUEST)
+
+iface.set_handler(START.EXCEPTION_LOWER, EXC.SYNC, guest_done)
+
+print(f"Starting guest at 0x{page:x}")
+iface.dev.timeout = None
+t = time.time()
+p.hv_start(page, 0)
+t = time.time() - t
+iface.dev.timeout = 3
+
+print(f"Guest printed {args.lines} lines ({args.lines * len(msg)} bytes) in {t:.3f}s")
@@ -32,6 +32,15 @@ class MachO:
             elif cmd.cmd == MachOLoadCmdType.UNIXTHREAD:
                 self.entry = cmd.args[0].data.pc
 
+    def image_size(self):
+        """The length of the prepare_image() output"""
+        size = self.vmax - self.vmin
+        for cmd in self.get_cmds(MachOLoadCmdType.SEGMENT_64):
+            filesize = min(self.size, cmd.args.fileoff + cmd.args.filesize) - cmd.args.fileoff
+            if cmd.args.segname == "PYLD" and cmd.args.vmsize > filesize:
+                size -= cmd.args.vmsize - filesize - 4
+        return size
+
     def prepare_image(self, load_hook=None):
         memory_size = self.vmax - self.vmin
 
@@ -59,6 +68,10 @@ class MachO:
 
         return image
 
+    def file_data(self):
+        self.io.seek(self.off)
+        return self.io.read(self.size)
+
     def get_cmds(self, cmdtype):
         for cmd in self.obj.cmds:
             if cmd.cmd == cmdtype:
@@ -1,7 +1,7 @@
 #!/usr/bin/env python3
 # SPDX-License-Identifier: MIT
 
-import os, sys, struct, serial, time
+import os, sys, struct, serial, time, select, ctypes, inspect
 from construct import *
 from utils import *
 from sysreg import *
@@ -61,6 +61,43 @@ class Serial(serial.Serial):
     def reset_input_buffer(self):
         super()._reset_input_buffer()
 
+IN_ATTRIB = 0x004
+IN_MOVED_TO = 0x080
+IN_CREATE = 0x100
+
+def wait_for_path(path, timeout):
+    """Wait for path to exist, returning False if it does not within timeout seconds.
+
+    On Linux this watches the parent directory with inotify, so a device node is noticed as
+    soon as udev creates it; elsewhere (or if the directory is missing) it polls.
+    """
+    deadline = time.monotonic() + timeout
+    fd = -1
+    try:
+        libc = ctypes.CDLL(None, use_errno=True)
+        fd = libc.inotify_init1(os.O_NONBLOCK | os.O_CLOEXEC)
+        if fd >= 0 and libc.inotify_add_watch(fd, os.fsencode(os.path.dirname(path) or "."),
+                                              IN_CREATE | IN_ATTRIB | IN_MOVED_TO) < 0:
+            os.close(fd)
+            fd = -1
+    except (OSError, AttributeError):
+        fd = -1
+
+    try:
+        while not os.path.exists(path):
+            remaining = deadline - time.monotonic()
+            if remaining <= 0:
+                return False
+            if fd >= 0:
+                if select.select([fd], [], [], remaining)[0]:
+                    os.read(fd, 4096)
+            else:
+                time.sleep(min(remaining, 0.01))
+        return True
+    finally:
+        if fd >= 0:
+            os.close(fd)
+
 class UartError(RuntimeError):
     pass
 
@@ -90,6 +127,29 @@ class EXC(IntEnum):
 
 class EVENT(IntEnum):
     MMIOTRACE = 1
+    PVCON = 2
+    MMIOTRACE_DELTA = 3
+    JOB = 4
+
+class FEAT(IntFlag):
+    INLINE_HOOK = 1 << 0
+    MEMREAD_TRAILER = 1 << 1
+    BAUD_CONFIRM = 1 << 2
+    MMIOTRACE_DELTA = 1 << 3
+    ASYNC_JOBS = 1 << 4
+    ADT_EDIT = 1 << 5
+    SPRR_SWEEP = 1 << 6
+    GZIP_MEMBERS = 1 << 7
+    MACHO_LOAD = 1 << 8
+    LZFSE = 1 << 9
+    TRACE_TIME = 1 << 10
+
+class JOB_STATE(IntEnum):
+    FREE = 0
+    RUNNING = 1
+    DONE = 2
+    FAILED = 3
+    CANCELLED = 4
 
 class EXC_RET(IntEnum):
     UNHANDLED = 1
@@ -97,7 +157,24 @@ class EXC_RET(IntEnum):
     EXIT_GUEST = 3
     STEP = 4
 
-ExcInfo = Struct(
+MachOInfo = Struct(
+    "entry" / Int64ul,
+    "vmin" / Int64ul,
+    "vmax" / Int64ul,
+    "image_size" / Int64ul,
+    "segments" / Int32ul,
+    "filesets" / Int32ul,
+)
+
+JobStatus = Struct(
+    "id" / Int32ul,
+    "state" / Int32ul,
+    "progress" / Int64ul,
+    "total" / Int64ul,
+    "retval" / Int64ul,
+)
+
+ExcInfo = FastStruct(Struct(
     "spsr" / RegAdapter(SPSR),
     "elr" / Int64ul,
     "esr" / RegAdapter(ESR),
@@ -109,7 +186,8 @@ ExcInfo = Struct(
     "far_phys" / Int64ul,
     "sp_phys" / Int64ul,
     "data" / Int64ul,
-)
+    "time" / Int64ul,
+))
 
 class UartInterface:
     REQ_NOP = 0x00AA55FF
@@ -156,6 +234,12 @@ class UartInterface:
         self.tty_enable = True
         self.handlers = {}
         self.evt_handlers = {}
+        # Filled in by link negotiation (see proxyutils.bootstrap_port); None means a
+        # current m1n1 is assumed
+        self.features = None
+        self.xfer_block = 8192
+        # Measured MEMWRITE throughput in bytes/s, see writemem()
+        self.tx_rate = None
 
     def checksum(self, data):
         sum = 0xDEADBEEF;
@@ -274,7 +358,19 @@ class UartInterface:
 
             if cmdin != cmd:
                 if cmdin == self.REQ_BOOT and status == self.ST_OK:
-                    self.handle_boot(data)
+                    inline_len = struct.unpack("<Q", data[16:24])[0]
+                    inline = None
+                    if inline_len:
+                        inline = self.readfull(inline_len + 4)
+                        if self.debug:
+                            print(">>", hexdump(inline))
+                        checksum = struct.unpack("<I", inline[-4:])[0]
+                        inline = inline[:-4]
+                        ccsum = self.checksum(inline)
+                        if checksum != ccsum:
+                            print("Inline data checksum error: Expected 0x%08x, got 0x%08x"%(checksum, ccsum))
+                            raise UartChecksumError()
+                    self.handle_boot(data, inline)
                     reply = b''
                     continue
                 raise UartCMDError("Reply command mismatch: Expected 0x%08x, got 0x%08x"%(cmd, cmdin))
@@ -291,19 +387,29 @@ class UartInterface:
                     raise UartRemoteError("Reply error: Unknown error (%d)"%status)
             return data
 
-    def handle_boot(self, data):
+    def handle_boot(self, data, inline=None):
         reason, code, info = struct.unpack("<IIQ", data[:16])
         reason = START(reason)
         info_type = None
         if reason in (START.EXCEPTION, START.EXCEPTION_LOWER):
             code = EXC(code)
         if (reason, code) in self.handlers:
-            self.handlers[(reason, code)](reason, code, info)
+            handler, takes_inline = self.handlers[(reason, code)]
+            if takes_inline:
+                handler(reason, code, info, inline)
+            else:
+                handler(reason, code, info)
         elif reason != START.BOOT:
             print(f"Proxy callback without handler: {reason}, {code}")
 
     def set_handler(self, reason, code, handler):
-        self.handlers[(reason, code)] = handler
+        # Only handlers that take a fourth argument get the inline hook payload
+        try:
+            inspect.signature(handler).bind(reason, code, 0, None)
+            takes_inline = True
+        except TypeError:
+            takes_inline = False
+        self.handlers[(reason, code)] = (handler, takes_inline)
 
     def handle_event(self, event_id, data):
         if event_id in self.evt_handlers:
@@ -312,7 +418,7 @@ class UartInterface:
     def set_event_handler(self, event_id, handler):
         self.evt_handlers[event_id] = handler
 
-    def wait_boot(self):
+    def wait_boot(self, timeout=10):
         try:
             return self.reply(self.REQ_BOOT)
         except:
@@ -320,18 +426,40 @@ class UartInterface:
             self.dev.close()
             print("Waiting for reconnection... ", end="")
             sys.stdout.flush()
-            for i in range(100):
-                print(".", end="")
-                sys.stdout.flush()
+            start = time.monotonic()
+            deadline = start + timeout
+            while True:
+                if not wait_for_path(self.dev.port, deadline - time.monotonic()):
+                    raise UartTimeout("Reconnection timed out")
                 try:
                     self.dev.open()
                 except serial.serialutil.SerialException:
-                    time.sleep(0.1)
-                else:
+                    # Gone again, or udev has not set up permissions yet
+                    if time.monotonic() > deadline:
+                        raise UartTimeout("Reconnection timed out")
+                    time.sleep(0.01)
+                    continue
+                # We may have caught the old node before it went away, and the boot message
+                # only goes out over UART, so check that the proxy answers
+                if self.probe():
                     break
-            else:
-                raise UartTimeout("Reconnection timed out")
-            print(" Connected")
+                self.dev.close()
+                if time.monotonic() > deadline:
+                    raise UartTimeout("Reconnection timed out")
+            print(f" Connected ({time.monotonic() - start:.2f}s)")
+
+    def probe(self, timeout=1):
+        """Check that the proxy answers a NOP on a freshly opened device"""
+        old_timeout = self.dev.timeout
+        self.dev.timeout = timeout
+        try:
+            self.dev.reset_input_buffer()
+            self.nop()
+            return True
+        except (UartError, serial.serialutil.SerialException, OSError):
+            return False
+        finally:
+            self.dev.timeout = old_timeout
 
     def nop(self):
         self.cmd(self.REQ_NOP)
@@ -349,6 +477,7 @@ class UartInterface:
             return self.reply(self.REQ_PROXY)
 
     def writemem(self, addr, data, progress=False):
+        start = time.perf_counter()
         checksum = self.checksum(data)
         size = len(data)
         req = struct.pack("<QQI", addr, size, checksum)
@@ -356,8 +485,8 @@ class UartInterface:
         if self.debug:
             print("<< DATA:")
             chexdump(data)
-        for i in range(0, len(data), 8192):
-            self.dev.write(data[i:i + 8192])
+        for i in range(0, len(data), self.xfer_block):
+            self.dev.write(data[i:i + self.xfer_block])
             if progress:
                 sys.stdout.write(".")
                 sys.stdout.flush()
@@ -366,15 +495,28 @@ class UartInterface:
         # should automatically report a CRC failure
         self.reply(self.REQ_MEMWRITE)
 
+        # Large enough writes are timed, checksum included, for compressed_writemem()
+        if size >= 65536:
+            rate = size / max(time.perf_counter() - start, 1e-6)
+            self.tx_rate = rate if self.tx_rate is None else (self.tx_rate + rate) / 2
+
     def readmem(self, addr, size):
         req = struct.pack("<QQ", addr, size)
         self.cmd(self.REQ_MEMREAD, req)
         reply = self.reply(self.REQ_MEMREAD)
-        checksum = struct.unpack("<I",reply[:4])[0]
+        if size == 0:
+            return b""
         data = self.readfull(size)
         if self.debug:
             print(">> DATA:")
             chexdump(data)
+        if self.features is None or self.features & FEAT.MEMREAD_TRAILER:
+            # The checksum and transfer status follow the data
+            checksum, status = struct.unpack("<Ii", self.readfull(8))
+            if status != self.ST_OK:
+                raise UartRemoteError("Reply error: Transfer error")
+        else:
+            checksum = struct.unpack("<I", reply[:4])[0]
         ccsum = self.checksum(data)
         if checksum != ccsum:
             raise UartChecksumError("Reply data checksum error: Expected 0x%08x, got 0x%08x"%(checksum, ccsum))
@@ -425,6 +567,8 @@ class M1N1Proxy:
     S_OK = 0
     S_BADCMD = -1
 
+    BAUD_SYNC = 0x005aa5f0
+
     P_NOP = 0x000
     P_EXIT = 0x001
     P_CALL = 0x002
@@ -439,6 +583,9 @@ class M1N1Proxy:
     P_VECTOR = 0x00b
     P_GL1_CALL = 0x00c
     P_GL2_CALL = 0x00d
+    P_GET_FEATURES = 0x00e
+    P_SPRR_SWEEP = 0x00f
+    P_SPRR_USED_INDICES = 0x010
 
     P_WRITE64 = 0x100
     P_WRITE32 = 0x101
@@ -492,6 +639,8 @@ class M1N1Proxy:
 
     P_XZDEC = 0x400
     P_GZDEC = 0x401
+    P_MACHO_LOAD = 0x402
+    P_LZFSEDEC = 0x403
 
     P_SMP_START_SECONDARIES = 0x500
     P_SMP_CALL = 0x501
@@ -533,6 +682,11 @@ class M1N1Proxy:
     P_HV_TRANSLATE = 0xc03
     P_HV_PT_WALK = 0xc04
     P_HV_MAP_VUART = 0xc05
+    P_HV_SET_PVCON = 0xc06
+    P_HV_SET_TIME_COMP = 0xc07
+    P_HV_GET_TIME_COMP_STATS = 0xc08
+    P_HV_RESET_VCPU = 0xc09
+    P_HV_SET_TRACE_TIME = 0xc0a
 
     P_FB_INIT = 0xd00
     P_FB_SHUTDOWN = 0xd01
@@ -543,10 +697,25 @@ class M1N1Proxy:
     P_FB_DISPLAY_LOGO = 0xd06
     P_FB_RESTORE_LOGO = 0xd07
 
+    P_JOB_SUBMIT = 0xe00
+    P_JOB_STATUS = 0xe01
+    P_JOB_WAIT = 0xe02
+    P_JOB_CANCEL = 0xe03
+    P_JOB_RELEASE = 0xe04
+
+    P_ADT_GET_SIZE = 0xf00
+    P_ADT_SETPROP = 0xf01
+    P_ADT_DELPROP = 0xf02
+    P_ADT_DEL_NODE = 0xf03
+
     def __init__(self, iface, debug=False):
         self.debug = debug
         self.iface = iface
         self.heap = None
+        # Latest EVT_JOB status per job ID, and optional per-job progress callbacks
+        self.jobs = {}
+        self.job_callbacks = {}
+        iface.set_event_handler(EVENT.JOB, self._handle_job_event)
 
     def _request(self, opcode, *args, reboot=False, signed=False, no_reply=False, pre_reply=None):
         if len(args) > 6:
@@ -555,7 +724,7 @@ class M1N1Proxy:
         req = struct.pack("<7Q", opcode, *args)
         if self.debug:
             print("<<<< %08x: %08x %08x %08x %08x %08x %08x"%tuple([opcode] + args))
-        reply = self.iface.proxyreq(req, reboot=reboot, no_reply=no_reply, pre_reply=None)
+        reply = self.iface.proxyreq(req, reboot=reboot, no_reply=no_reply, pre_reply=pre_reply)
         if no_reply or reboot and reply is None:
             return
         ret_fmt = "q" if signed else "Q"
@@ -596,8 +765,8 @@ class M1N1Proxy:
 
     def nop(self):
         self.request(self.P_NOP)
-    def exit(self, retval=0):
-        self.request(self.P_EXIT, retval)
+    def exit(self, retval=0, data=0):
+        self.request(self.P_EXIT, retval, data)
     def call(self, addr, *args, reboot=False):
         if len(args) > 4:
             raise ValueError("Too many arguments")
@@ -621,14 +790,44 @@ class M1N1Proxy:
         return self.request(self.P_GET_BOOTARGS)
     def get_base(self):
         return self.request(self.P_GET_BASE)
-    def set_baud(self, baudrate):
+    def set_baud(self, baudrate, confirm_timeout=0):
+        """Change the UART baud rate.
+
+        With confirm_timeout (in seconds), m1n1 waits that long for the sync word to be echoed
+        back at the new rate and reverts to the old rate otherwise. Returns whether the new rate
+        is in effect.
+        """
+        sync = struct.pack("<I", self.BAUD_SYNC)
+        old = self.iface.dev.baudrate
         self.iface.tty_enable = False
         def change():
             self.iface.dev.baudrate = baudrate
+            if not confirm_timeout:
+                return
+            # Only echo once the sync words show up, so m1n1 is already listening at the new rate
+            window = b""
+            deadline = time.time() + confirm_timeout
+            while sync not in window and time.time() < deadline:
+                window = window[-3:] + self.iface.dev.read(4)
+            if sync in window:
+                self.iface.dev.write(sync)
         try:
-            self.request(self.P_SET_BAUD, baudrate, 16, 0x005aa5f0, pre_reply=change)
+            ret = self.request(self.P_SET_BAUD, baudrate, 16, self.BAUD_SYNC,
+                               int(confirm_timeout * 1000000), pre_reply=change)
+        except UartError:
+            if not confirm_timeout:
+                raise
+            # m1n1 gave up and replied at the old rate
+            ret = old
         finally:
             self.iface.tty_enable = True
+        if ret != baudrate:
+            self.iface.dev.baudrate = old
+            self.iface.dev.reset_input_buffer()
+            return False
+        return True
+    def get_features(self):
+        return FEAT(self.request(self.P_GET_FEATURES))
     def udelay(self, usec):
         self.request(self.P_UDELAY, usec)
     def set_exc_guard(self, mode):
@@ -651,6 +850,10 @@ class M1N1Proxy:
         if len(args) > 4:
             raise ValueError("Too many arguments")
         return self.request(self.P_GL2_CALL, addr, *args)
+    def sprr_sweep(self, page, indices, values, results):
+        return self.request(self.P_SPRR_SWEEP, page, indices, values, results, signed=True)
+    def sprr_used_indices(self):
+        return self.request(self.P_SPRR_USED_INDICES)
 
     def write64(self, addr, data):
         if addr & 7:
@@ -805,6 +1008,11 @@ class M1N1Proxy:
     def gzdec(self, inbuf, insize, outbuf, outsize):
         return self.request(self.P_GZDEC, inbuf, insize, outbuf,
                             outsize, signed=True)
+    def macho_load(self, src, size, dest, dest_size, info):
+        return self.request(self.P_MACHO_LOAD, src, size, dest, dest_size, info, signed=True)
+    def lzfsedec(self, inbuf, insize, outbuf, outsize):
+        return self.request(self.P_LZFSEDEC, inbuf, insize, outbuf,
+                            outsize, signed=True)
 
     def smp_start_secondaries(self):
         self.request(self.P_SMP_START_SECONDARIES)
@@ -887,6 +1095,17 @@ class M1N1Proxy:
         return self.request(self.P_HV_PT_WALK, addr)
     def hv_map_vuart(self, base, iodev):
         return self.request(self.P_HV_MAP_VUART, base, iodev)
+    def hv_set_pvcon(self, iodev=None):
+        # None sends guest console output to the host as events
+        return self.request(self.P_HV_SET_PVCON, 0xffffffffffffffff if iodev is None else iodev)
+    def hv_set_time_comp(self, enable, cap_us=0):
+        return self.request(self.P_HV_SET_TIME_COMP, enable, cap_us)
+    def hv_get_time_comp_stats(self):
+        return self.request(self.P_HV_GET_TIME_COMP_STATS)
+    def hv_reset_vcpu(self):
+        return self.request(self.P_HV_RESET_VCPU)
+    def hv_set_trace_time(self, enable):
+        return self.request(self.P_HV_SET_TRACE_TIME, enable)
 
     def fb_init(self):
         return self.request(self.P_FB_INIT)
@@ -905,6 +1124,76 @@ class M1N1Proxy:
     def fb_restore_logo(self):
         return self.request(self.P_FB_RESTORE_LOGO)
 
+    def _handle_job_event(self, data):
+        status = JobStatus.parse(data)
+        self.jobs[status.id] = status
+        cb = self.job_callbacks.get(status.id)
+        if cb:
+            cb(status)
+
+    def job_submit(self, opcode, *args):
+        """Start a memcpy/memset, gzdec, xzdec or lzfsedec op in the background and return its
+        job ID."""
+        if len(args) > 5:
+            raise ValueError("Too many arguments")
+        job = self.request(self.P_JOB_SUBMIT, opcode, *args)
+        if not job:
+            raise ProxyRemoteError(f"Op 0x{opcode:x} cannot run as a job (or no free job slot)")
+        return job
+    def job_status(self, job):
+        ptr = self.request(self.P_JOB_STATUS, job)
+        if not ptr:
+            return None
+        return JobStatus.parse(self.iface.readmem(ptr, JobStatus.sizeof()))
+    def job_wait(self, job, timeout=1.0):
+        """Wait up to timeout seconds on the target, returns the JOB_STATE."""
+        return JOB_STATE(self.request(self.P_JOB_WAIT, job, int(timeout * 1000000), signed=True))
+    def job_cancel(self, job):
+        return self.request(self.P_JOB_CANCEL, job, signed=True)
+    def job_release(self, job):
+        self.jobs.pop(job, None)
+        self.job_callbacks.pop(job, None)
+        return self.request(self.P_JOB_RELEASE, job, signed=True)
+
+    def adt_get_size(self, adt):
+        return self.request(self.P_ADT_GET_SIZE, adt, signed=True)
+    def adt_setprop(self, adt, bufsize, path, name, value):
+        value = bytes(value)
+        return self.request(self.P_ADT_SETPROP, adt, bufsize, path, name,
+                            *((value, None) if value else (0, 0)), signed=True)
+    def adt_delprop(self, adt, path, name):
+        return self.request(self.P_ADT_DELPROP, adt, path, name, signed=True)
+    def adt_del_node(self, adt, path):
+        return self.request(self.P_ADT_DEL_NODE, adt, path, signed=True)
+
+    def run_job(self, opcode, *args, progress=None, poll=1.0, signed=False):
+        """Run an op as a job, waiting in bounded steps so the serial timeout never trips.
+
+        progress(status) is called for each EVT_JOB update. Returns the op's return value, and
+        raises if the job failed or was cancelled (e.g. on KeyboardInterrupt).
+        """
+        job = self.job_submit(opcode, *args)
+        if progress:
+            self.job_callbacks[job] = progress
+        try:
+            state = JOB_STATE.RUNNING
+            while state == JOB_STATE.RUNNING:
+                state = self.job_wait(job, poll)
+        except KeyboardInterrupt:
+            self.job_cancel(job)
+            while self.job_wait(job, poll) == JOB_STATE.RUNNING:
+                pass
+            self.job_release(job)
+            raise
+        status = self.job_status(job)
+        self.job_release(job)
+        if state != JOB_STATE.DONE:
+            raise ProxyRemoteError(f"Job {job} (op 0x{opcode:x}) ended as {state.name}")
+        retval = status.retval
+        if signed and retval & (1 << 63):
+            retval -= 1 << 64
+        return retval
+
 if __name__ == "__main__":
     import serial
     uartdev = os.environ.get("M1N1DEVICE", "/dev/ttyUSB0")
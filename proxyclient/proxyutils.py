@@ -1,10 +1,77 @@
-import serial, os, struct, sys, time, json, os.path, gzip, functools
+import serial, os, struct, sys, time, json, os.path, gzip, functools, zlib
 from asm import ARMAsm
 from proxy import *
 from tgtypes import *
 from sysreg import *
 import malloc, adt
 from contextlib import contextmanager
+from concurrent.futures import ThreadPoolExecutor
+
+GZIP_MEMBER_SIZE = 4 * 1024 * 1024
+GZIP_MAX_MEMBERS = 8190     # so the member table fits in one FEXTRA subfield
+GZIP_HEADER = struct.pack("<BBBBIBB", 0x1f, 0x8b, 8, 0, 0, 0, 0xff)
+
+# Compression levels compressed_writemem() picks from; 0 sends the data as is
+COMPRESS_LEVELS = (0, 1, 6, 9)
+COMPRESS_SAMPLE = 256 * 1024
+
+def gzip_member_chunks(data, member_size=GZIP_MEMBER_SIZE):
+    member_size = max(member_size, -(-len(data) // GZIP_MAX_MEMBERS))
+    view = memoryview(data)
+    return [view[i:i + member_size] for i in range(0, len(data), member_size)]
+
+def gzip_member(chunk, level=9, first=False):
+    """Compress one gzip member, minus the header for the first one, see gzip_first_header()"""
+    c = zlib.compressobj(level, zlib.DEFLATED, -15)
+    body = c.compress(chunk) + c.flush()
+    trailer = struct.pack("<II", zlib.crc32(chunk), len(chunk) & 0xffffffff)
+    return (b"" if first else GZIP_HEADER) + body + trailer
+
+def gzip_first_header_len(count):
+    return 10 + 2 + 4 + 4 + 8 * count
+
+def gzip_first_header(sizes):
+    """Build the first member's header with the member table, from (compressed size,
+    uncompressed size) pairs as returned for gzip_member() output. The first compressed size
+    excludes this header."""
+    hdr_len = gzip_first_header_len(len(sizes))
+    table = struct.pack("<I", len(sizes))
+    for i, (csize, usize) in enumerate(sizes):
+        table += struct.pack("<II", csize + (hdr_len if i == 0 else 0), usize)
+    return (struct.pack("<BBBBIBBH", 0x1f, 0x8b, 8, 4, 0, 0, 0xff, 4 + len(table)) +
+            struct.pack("<BBH", ord("m"), ord("T"), len(table)) + table)
+
+def gzip_members(data, member_size=GZIP_MEMBER_SIZE, level=9):
+    """Compress data into a multi-member gzip stream that m1n1 can decompress on several cores
+    at once. The first member's FEXTRA field holds the member table, see src/gzip.h."""
+    chunks = gzip_member_chunks(data, member_size)
+    members = [gzip_member(chunk, level, i == 0) for i, chunk in enumerate(chunks)]
+    sizes = [(len(m), len(c)) for m, c in zip(members, chunks)]
+    return gzip_first_header(sizes) + b"".join(members)
+
+def pick_compress_level(data, tx_rate, threads, streamed):
+    """Pick the level that gets data across soonest, given the link throughput (bytes/s), the
+    number of compression threads and whether compressed data is sent while the rest is still
+    being compressed, by compressing a sample at each level."""
+    sample = bytes(memoryview(data)[:COMPRESS_SAMPLE])
+    best, best_time = 9, None
+    for level in COMPRESS_LEVELS:
+        if level == 0:
+            ratio, rate = 1, None
+        else:
+            t = time.perf_counter()
+            ratio = len(zlib.compress(sample, level)) / len(sample)
+            rate = len(sample) * threads / max(time.perf_counter() - t, 1e-6)
+        compress_time = len(data) / rate if rate else 0
+        transfer_time = len(data) * ratio / tx_rate
+        # Streamed, compression and transfer overlap and whichever is slower sets the pace
+        if streamed:
+            est = max(compress_time, transfer_time)
+        else:
+            est = compress_time + transfer_time
+        if best_time is None or est < best_time:
+            best, best_time = level, est
+    return best
 
 class ProxyUtils(object):
     def __init__(self, p, heap_size=1024 * 1024 * 1024):
@@ -87,19 +154,101 @@ class ProxyUtils(object):
         if not len(data):
             return
 
-        payload = gzip.compress(data)
-        compressed_size = len(payload)
+        features = self.iface.features
+        members = len(data) >= 2 * GZIP_MEMBER_SIZE and (features is None or
+                                                          features & FEAT.GZIP_MEMBERS)
+        threads = (os.cpu_count() or 1) if members else 1
+        level = 9
+        # Until a transfer has been timed, assume the link is slow and compress as much as we can
+        if self.iface.tx_rate is not None and len(data) >= 4 * COMPRESS_SAMPLE:
+            level = pick_compress_level(data, self.iface.tx_rate, threads, members)
+
+        if level == 0:
+            self.iface.writemem(dest, data, progress)
+            return
+
+        # Large uploads are split into gzip members, which are compressed by a thread pool and
+        # sent as they come out, and decompress on all idle cores on the target
+        if members:
+            chunks = gzip_member_chunks(data)
+            hdr_len = gzip_first_header_len(len(chunks))
+            # zlib's worst case for incompressible data, plus the member headers and trailers
+            bound = hdr_len + sum(len(c) + (len(c) >> 12) + (len(c) >> 14) + 64 for c in chunks)
+
+            with self.heap.guarded_malloc(bound) as compressed_addr, \
+                 ThreadPoolExecutor(threads) as pool:
+                futures = [pool.submit(gzip_member, chunk, level, i == 0)
+                           for i, chunk in enumerate(chunks)]
+                off, sizes = hdr_len, []
+                for chunk, future in zip(chunks, futures):
+                    member = future.result()
+                    self.iface.writemem(compressed_addr + off, member, progress)
+                    off += len(member)
+                    sizes.append((len(member), len(chunk)))
+                self.iface.writemem(compressed_addr, gzip_first_header(sizes))
+                self._decompress(self.proxy.P_GZDEC, compressed_addr, off, dest, len(data))
+            return
 
-        with self.heap.guarded_malloc(compressed_size) as compressed_addr:
+        payload = gzip.compress(data, level)
+        with self.heap.guarded_malloc(len(payload)) as compressed_addr:
             self.iface.writemem(compressed_addr, payload, progress)
-            timeout = self.iface.dev.timeout
-            self.iface.dev.timeout = None
-            try:
-                decompressed_size = self.proxy.gzdec(compressed_addr, compressed_size, dest, len(data))
-            finally:
-                self.iface.dev.timeout = timeout
+            self._decompress(self.proxy.P_GZDEC, compressed_addr, len(payload), dest,
+                             len(data))
+
+    def _decompress(self, opcode, compressed_addr, compressed_size, dest, size, exact=True):
+        features = self.iface.features
+        # With no idle core, m1n1 decompresses jobs from its run-loop and serves no requests
+        # until it is done, so a job wait can take as long as the plain op
+        timeout = self.iface.dev.timeout
+        self.iface.dev.timeout = None
+        try:
+            if features is None or features & FEAT.ASYNC_JOBS:
+                decompressed_size = self.proxy.run_job(opcode, compressed_addr, compressed_size,
+                                                       dest, size, signed=True)
+            else:
+                decompressed_size = self.proxy.request(opcode, compressed_addr, compressed_size,
+                                                       dest, size, signed=True)
+        finally:
+            self.iface.dev.timeout = timeout
+
+        if exact:
+            assert decompressed_size == size
+        return decompressed_size
 
-            assert decompressed_size == len(data)
+    def lzfse_writemem(self, dest, payload, dest_size, progress=True):
+        """Upload an LZFSE/LZVN compressed file (e.g. an Apple kernelcache payload) as it is and
+        decode it to dest on the target. Returns the decoded size, or None if m1n1 cannot."""
+        features = self.iface.features
+        if features is not None and not features & FEAT.LZFSE:
+            return None
+
+        with self.heap.guarded_malloc(len(payload)) as compressed_addr:
+            self.iface.writemem(compressed_addr, payload, progress)
+            size = self._decompress(self.proxy.P_LZFSEDEC, compressed_addr, len(payload), dest,
+                                    dest_size, exact=False)
+        if size < 0:
+            raise ProxyError(f"LZFSE decode failed ({size})")
+        return size
+
+    def load_macho(self, macho, dest, dest_size):
+        """Upload a MachO's file and lay it out at dest on the target, instead of uploading
+        macho.prepare_image(). Returns the target's MachOInfo, or None if m1n1 cannot do it."""
+        features = self.iface.features
+        if features is not None and not features & FEAT.MACHO_LOAD:
+            return None
+
+        data = macho.file_data()
+        info_off = align(len(data), 8)
+        with self.heap.guarded_malloc(info_off + MachOInfo.sizeof()) as src:
+            info_addr = src + info_off
+            self.compressed_writemem(src, data, True)
+            try:
+                ret = self.proxy.macho_load(src, len(data), dest, dest_size, info_addr)
+            except ProxyCommandError:
+                return None
+            if ret < 0:
+                raise ProxyError(f"Mach-O load failed ({ret})")
+            return self.iface.readstruct(info_addr, MachOInfo)
 
     def get_adt(self):
         if self.adt_data is not None:
@@ -111,11 +260,54 @@ class ProxyUtils(object):
         return self.adt_data
 
     def push_adt(self):
-        self.adt_data = self.adt.build()
         adt_base = self.ba.devtree - self.ba.virt_base + self.ba.phys_base
-        adt_size = len(self.adt_data)
-        print(f"Pushing ADT ({adt_size} bytes)...")
-        self.iface.writemem(adt_base, self.adt_data)
+        adt_size = None
+        # Edits are relative to the ADT as fetched, so there is nothing to patch without it
+        if self.adt_data is not None:
+            try:
+                capacity = self.adt["chosen"]["memory-map"].DeviceTree[1]
+            except (KeyError, AttributeError):
+                capacity = self.ba.devtree_size
+            adt_size = self.patch_adt(adt_base, capacity, self.adt.edits())
+
+        if adt_size is None:
+            self.adt_data = self.adt.build()
+            adt_size = len(self.adt_data)
+            print(f"Pushing ADT ({adt_size} bytes)...")
+            self.iface.writemem(adt_base, self.adt_data)
+        else:
+            # Fetch it again if anyone asks, rather than building it here
+            self.adt_data = None
+
+        self.adt.mark_clean()
+
+    def patch_adt(self, adt_base, capacity, edits):
+        """Apply ADTNode.edits() to the ADT at adt_base in place.
+
+        Returns the new ADT size, or None if the edits could not be applied (a full rebuild is
+        needed, m1n1 is too old or an edit failed) and the caller must upload a full build.
+        """
+        features = self.iface.features
+        if edits is None or (features is not None and not features & FEAT.ADT_EDIT):
+            return None
+
+        print(f"Patching ADT in place ({len(edits)} edits)...")
+        try:
+            size = self.proxy.adt_get_size(adt_base)
+            for op, path, *args in edits:
+                if op == "set":
+                    size = self.proxy.adt_setprop(adt_base, capacity, path, *args)
+                elif op == "del_prop":
+                    size = self.proxy.adt_delprop(adt_base, path, *args)
+                else:
+                    size = self.proxy.adt_del_node(adt_base, path)
+                if size < 0:
+                    print(f"ADT edit {op} {path} {args[:1]} failed ({size})")
+                    return None
+        except ProxyCommandError:
+            return None
+
+        return size
 
     def disassemble_at(self, start, size, pc=None):
         code = struct.unpack(f"<{size // 4}I", self.iface.readmem(start, size))
@@ -295,13 +487,151 @@ class GuardedHeap:
             self.free(ptr)
         self.ptrs = set()
 
-def bootstrap_port(iface, proxy):
+# The UART runs off a 24MHz clock with 16x oversampling and an integer divider, so these are
+# the rates it can hit exactly (plus the 115200 default).
+UART_BAUD_RATES = [115200, 250000, 300000, 375000, 500000, 750000, 1500000]
+LINK_CACHE = os.path.join(os.path.expanduser("~"), ".m1n1", "links.json")
+
+def _adapter_id(iface):
+    path = iface.devpath
+    if path is None:
+        return None
     try:
-        iface.dev.timeout = 0.15
-        iface.nop()
-        proxy.set_baud(1500000)
-    except UartTimeout:
-        iface.dev.baudrate = 1500000
+        from serial.tools import list_ports
+        real = os.path.realpath(path)
+        for port in list_ports.comports():
+            if port.device in (path, real) and port.vid is not None:
+                return f"{port.vid:04x}:{port.pid:04x}:{port.serial_number}"
+    except ImportError:
+        pass
+    return path
+
+def _load_link_cache():
+    try:
+        with open(LINK_CACHE) as fd:
+            return json.load(fd)
+    except (OSError, ValueError):
+        return {}
+
+def _save_link_cache(cache):
+    try:
+        os.makedirs(os.path.dirname(LINK_CACHE), exist_ok=True)
+        with open(LINK_CACHE, "w") as fd:
+            json.dump(cache, fd, indent=1)
+    except OSError:
+        pass
+
+def _try_nop(iface, tries=3):
+    for i in range(tries):
+        try:
+            iface.nop()
+            return True
+        except UartError:
+            iface.dev.reset_input_buffer()
+    return False
+
+def _resync(iface, rates):
+    """Find the rate m1n1 is listening at, after a failed transfer or a lost reply."""
+    # Pad out any memory transfer m1n1 might still be waiting on; zeroes are skipped while it
+    # looks for the next command.
+    iface.dev.write(bytes(LINK_BURST_SIZE))
+    for rate in rates:
+        iface.dev.baudrate = rate
+        iface.dev.reset_input_buffer()
+        if _try_nop(iface):
+            return rate
+    raise UartTimeout("Lost the link to m1n1")
+
+LINK_BURST_SIZE = 0x4000
+
+def link_burst_test(iface, proxy, rounds=3, size=LINK_BURST_SIZE):
+    """Loop random data through target memory; any checksum error, timeout or mismatch fails."""
+    buf = proxy.malloc(size)
+    if not buf:
+        raise ProxyRemoteError("Out of memory for the link test")
+    try:
+        for i in range(rounds):
+            data = os.urandom(size)
+            iface.writemem(buf, data)
+            if iface.readmem(buf, size) != data:
+                return False
+        return True
+    except UartError:
+        return False
+    finally:
+        try:
+            proxy.free(buf)
+        except UartError:
+            pass
+
+def negotiate_baud(iface, proxy, rates=UART_BAUD_RATES, rounds=3):
+    """Step up through the candidate rates, keeping the fastest one that survives the burst test.
+
+    Each step is confirmed by m1n1 (P_SET_BAUD reverts on its own if the host can't answer at
+    the new rate), so a bad rate costs a timeout rather than the connection.
+    """
+    good = iface.dev.baudrate
+    for rate in sorted(rates):
+        if rate <= good:
+            continue
+        if not proxy.set_baud(rate, confirm_timeout=0.5):
+            break
+        if link_burst_test(iface, proxy, rounds):
+            good = rate
+            continue
+        print(f"Link: {rate} baud failed the loopback test, staying at {good}")
+        _resync(iface, [rate, good])
+        if not proxy.set_baud(good, confirm_timeout=0.5):
+            _resync(iface, [good, rate])
+        break
+    return good
+
+def bootstrap_port(iface, proxy, rates=UART_BAUD_RATES, renegotiate=False):
+    """Bring up the proxy link at the best speed the adapter supports.
+
+    Serial links step up through the candidate baud rates (see negotiate_baud) and remember the
+    result per adapter in LINK_CACHE. USB links have no baud rate; for those only protocol
+    features and transfer sizes are negotiated.
+    """
+    iface.dev.timeout = 0.15
+
+    # m1n1 may still be running at a rate negotiated by a previous session
+    cache = _load_link_cache()
+    adapter = _adapter_id(iface)
+    cached = cache.get(adapter, {}).get("baud")
+    if not _try_nop(iface, 1):
+        _resync(iface, ([cached] if cached else []) + sorted(rates, reverse=True))
+
+    try:
+        iface.features = proxy.get_features()
+    except ProxyCommandError:
+        iface.features = FEAT(0)
+
+    try:
+        link = proxy.iodev_whoami()
+    except ProxyCommandError:
+        link = IODEV.UART
+
+    if link != IODEV.UART:
+        iface.xfer_block = 0x10000
+    elif not iface.features & FEAT.BAUD_CONFIRM:
+        # Older m1n1: no way to back out of a bad rate, so stick to the historical default
+        if iface.dev.baudrate != 1500000:
+            try:
+                proxy.set_baud(1500000)
+            except UartTimeout:
+                iface.dev.baudrate = 1500000
+    elif renegotiate or iface.dev.baudrate != cached:
+        baud = None
+        if cached and not renegotiate:
+            # Jump straight to the rate that worked last time
+            if negotiate_baud(iface, proxy, [cached], rounds=1) == cached:
+                baud = cached
+        if baud is None:
+            baud = negotiate_baud(iface, proxy, rates)
+            if adapter:
+                cache[adapter] = {"baud": baud}
+                _save_link_cache(cache)
 
     iface.nop()
     iface.dev.timeout = 3
@@ -4,6 +4,8 @@ import argparse, pathlib
 
 parser = argparse.ArgumentParser(description='Run a Mach-O payload under the hypervisor')
 parser.add_argument('-s', '--symbols', type=pathlib.Path)
+parser.add_argument('-t', '--trace', type=pathlib.Path,
+                    help='record a timeline trace (convert it with timeline.py)')
 parser.add_argument('payload', type=pathlib.Path)
 parser.add_argument('boot_args', default=[], nargs="*")
 args = parser.parse_args()
@@ -22,6 +24,9 @@ hv = HV(iface, p, u)
 
 hv.init()
 
+if args.trace:
+    hv.trace_to(args.trace)
+
 if len(args.boot_args) > 0:
     boot_args = " ".join(args.boot_args)
     hv.set_bootargs(boot_args)
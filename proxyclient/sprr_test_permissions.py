@@ -4,6 +4,32 @@ from setup import *
 import asm
 from contextlib import contextmanager
 
+# m1n1 can run the whole matrix itself: every permission value for every SPRR index that none of
+# its own mappings (code, data, RAM aliases, MMIO) use, each probed at EL and GL.
+if iface.features is None or iface.features & FEAT.SPRR_SWEEP:
+    indices = 0xffff & ~p.sprr_used_indices()
+    page = u.memalign(0x4000, 0x4000)
+    results = u.malloc(0x100)
+    print("Running SPRR sweep on the target...")
+    count = p.sprr_sweep(page, indices, 0xffff, results)
+    table = iface.readmem(results, 0x100)
+    u.free(results)
+    u.free(page)
+    if count < 0:
+        raise Exception(f"SPRR sweep failed ({count})")
+
+    def fmt(bits):
+        return "".join(c if bits & (1 << i) else "-" for i, c in enumerate("rwx"))
+
+    for idx in range(16):
+        if not indices & (1 << idx):
+            continue
+        print(f"SPRR index {idx:04b}:")
+        for val in range(16):
+            res = table[idx * 16 + val]
+            print(f"  SPRR: {val:04b} GL: {fmt(res >> 3)} EL: {fmt(res)}")
+    sys.exit(0)
+
 p.smp_start_secondaries()
 
 
@@ -1,7 +1,8 @@
 # SPDX-License-Identifier: MIT
 from construct import *
+from utils import FastStruct
 
-BootArgs = Struct(
+BootArgs = FastStruct(Struct(
     "revision"              / Hex(Int16ul),
     "version"               / Hex(Int16ul),
     Padding(4),
@@ -25,7 +26,7 @@ BootArgs = Struct(
     Padding(4),
     "boot_flags"            / Hex(Int64ul),
     "mem_size_actual"       / Hex(Int64ul),
-)
+))
 
 MachOLoadCmdType = "LoadCmdType" / Enum(Int32ul,
     SYMTAB = 0x02,
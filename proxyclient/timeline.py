@@ -0,0 +1,229 @@
+#!/usr/bin/env python3
+# SPDX-License-Identifier: MIT
+"""Timeline traces of MMIO accesses, hypervisor exits and host-side stages.
+
+TraceSink writes a compact binary stream as events come in, all timestamped in target timer
+ticks (CNTPCT_EL0); host-side events are mapped onto the same timebase. MMIO accesses go to
+one track per device, named after the ADT node whose reg range contains the address. The
+stream is converted offline into a Chrome JSON trace that Perfetto (ui.perfetto.dev) and
+chrome://tracing load:
+
+    python3 timeline.py guest.m1trace guest.json
+"""
+
+import bisect, json, struct, sys, time
+from contextlib import contextmanager
+
+MAGIC = b"m1n1trc\0"
+VERSION = 1
+
+HEADER = struct.Struct("<8sII")     # magic, version, timer frequency
+
+REC_TRACK = 0   # u16 track, u16 len, name
+REC_MMIO = 1    # u16 track, u8 flags, u64 time, pc, addr, data
+REC_BEGIN = 2   # u16 track, u64 time, u16 len, name
+REC_END = 3     # u16 track, u64 time
+REC_INSTANT = 4 # u16 track, u64 time, u16 len, name
+
+MMIO_WRITE = 1 << 3
+
+_TRACK = struct.Struct("<BHH")
+_MMIO = struct.Struct("<BHBQQQQ")
+_EVENT = struct.Struct("<BHQH")
+_END = struct.Struct("<BHQ")
+
+class DeviceMap:
+    """Map physical addresses to ADT device names through their reg ranges"""
+    def __init__(self, adt=None):
+        self.ranges = []
+        if adt is not None:
+            self._walk(adt)
+        self.ranges.sort()
+        self.starts = [r[0] for r in self.ranges]
+        self.cache = {}
+
+    def _walk(self, node):
+        if "reg" in node._properties:
+            try:
+                for i in range(len(node.reg)):
+                    addr, size = node.get_reg(i)
+                    if size:
+                        self.ranges.append((addr, addr + size, node._path.split("/", 2)[-1]))
+            except Exception:
+                pass
+        for child in node:
+            self._walk(child)
+
+    def lookup(self, addr):
+        page = addr >> 14
+        name = self.cache.get(page, False)
+        if name is not False:
+            return name
+        # The innermost range containing addr, in case some nodes' ranges nest
+        idx = bisect.bisect_right(self.starts, addr) - 1
+        while idx >= 0:
+            start, end, name = self.ranges[idx]
+            if addr < end:
+                break
+            idx -= 1
+        else:
+            return None
+        # Devices usually own whole pages; only those can be answered from the cache
+        if start <= (page << 14) and ((page + 1) << 14) <= end:
+            self.cache[page] = name
+        return name
+
+class TraceSink:
+    def __init__(self, path, freq=24000000, adt=None, u=None):
+        if u is not None:
+            from sysreg import CNTFRQ_EL0, CNTPCT_EL0
+            freq = u.mrs(CNTFRQ_EL0)
+            if adt is None:
+                adt = u.adt
+            # Take the host clock and the target counter as close together as we can
+            t0 = time.perf_counter()
+            ticks = u.mrs(CNTPCT_EL0)
+            t1 = time.perf_counter()
+            self.sync(ticks, (t0 + t1) / 2)
+        else:
+            self.sync(0, time.perf_counter())
+
+        self.freq = freq
+        self.devices = DeviceMap(adt)
+        self.tracks = {}
+        self.fd = open(path, "wb")
+        self.fd.write(HEADER.pack(MAGIC, VERSION, freq))
+
+    def sync(self, ticks, host_time=None):
+        """Anchor the host clock (time.perf_counter()) to a target counter value"""
+        self.sync_ticks = ticks
+        self.sync_host = time.perf_counter() if host_time is None else host_time
+
+    def now(self):
+        """The current time in target timer ticks, estimated from the host clock"""
+        return self.sync_ticks + int((time.perf_counter() - self.sync_host) * self.freq)
+
+    def track(self, name):
+        tid = self.tracks.get(name, None)
+        if tid is None:
+            tid = self.tracks[name] = len(self.tracks)
+            data = name.encode("utf-8")
+            self.fd.write(_TRACK.pack(REC_TRACK, tid, len(data)) + data)
+        return tid
+
+    def mmio(self, ticks, pc, addr, data, width, write):
+        dev = self.devices.lookup(addr)
+        tid = self.track(f"MMIO {dev}" if dev else "MMIO (unknown)")
+        flags = (width & 7) | (MMIO_WRITE if write else 0)
+        self.fd.write(_MMIO.pack(REC_MMIO, tid, flags, ticks if ticks is not None else self.now(),
+                                 pc, addr, data))
+
+    def _event(self, rec, track, name, ticks):
+        data = name.encode("utf-8")
+        self.fd.write(_EVENT.pack(rec, self.track(track), self.now() if ticks is None else ticks,
+                                  len(data)) + data)
+
+    def begin(self, track, name, ticks=None):
+        self._event(REC_BEGIN, track, name, ticks)
+
+    def end(self, track, ticks=None):
+        self.fd.write(_END.pack(REC_END, self.track(track),
+                                self.now() if ticks is None else ticks))
+
+    def instant(self, track, name, ticks=None):
+        self._event(REC_INSTANT, track, name, ticks)
+
+    @contextmanager
+    def span(self, name, track="host"):
+        """Time a host-side stage, e.g. with sink.span("load kernel"): ..."""
+        self.begin(track, name)
+        try:
+            yield
+        finally:
+            self.end(track)
+
+    def flush(self):
+        self.fd.flush()
+
+    def close(self):
+        if self.fd is not None:
+            self.fd.close()
+            self.fd = None
+
+def read_trace(fd):
+    """Yield (record type, track, ticks, fields...) from a trace stream; REC_TRACK yields
+    (REC_TRACK, track, name)"""
+    magic, version, freq = HEADER.unpack(fd.read(HEADER.size))
+    if magic != MAGIC or version != VERSION:
+        raise ValueError("Not an m1n1 trace (or an unsupported version)")
+    yield freq
+
+    data = fd.read()
+    off = 0
+    while off < len(data):
+        rec = data[off]
+        if rec == REC_MMIO:
+            if off + _MMIO.size > len(data):
+                break
+            yield _MMIO.unpack_from(data, off)
+            off += _MMIO.size
+        elif rec == REC_END:
+            if off + _END.size > len(data):
+                break
+            yield _END.unpack_from(data, off)
+            off += _END.size
+        elif rec == REC_TRACK:
+            _, tid, n = _TRACK.unpack_from(data, off)
+            off += _TRACK.size
+            yield REC_TRACK, tid, data[off:off + n].decode("utf-8")
+            off += n
+        elif rec in (REC_BEGIN, REC_INSTANT):
+            if off + _EVENT.size > len(data):
+                break
+            _, tid, ticks, n = _EVENT.unpack_from(data, off)
+            off += _EVENT.size
+            yield rec, tid, ticks, data[off:off + n].decode("utf-8")
+            off += n
+        else:
+            raise ValueError(f"Bad trace record type {rec} at offset {off + HEADER.size}")
+
+def convert(src, dst):
+    """Convert a trace stream to the Chrome JSON trace format, one event per line"""
+    with open(src, "rb") as fd, open(dst, "w") as out:
+        records = read_trace(fd)
+        freq = next(records)
+        base = None
+        us = lambda ticks: round((ticks - base) * 1000000 / freq, 3)
+
+        out.write('{"displayTimeUnit": "ns", "traceEvents": [\n')
+        out.write(json.dumps({"name": "process_name", "ph": "M", "pid": 1, "tid": 0,
+                              "args": {"name": "m1n1"}}))
+        for r in records:
+            rec, tid = r[0], r[1] + 1
+            if rec == REC_TRACK:
+                evt = {"name": "thread_name", "ph": "M", "pid": 1, "tid": tid,
+                       "args": {"name": r[2]}}
+            else:
+                if base is None:
+                    base = r[3] if rec == REC_MMIO else r[2]
+                if rec == REC_MMIO:
+                    _, _, flags, ticks, pc, addr, data = r
+                    width = 8 << (flags & 7)
+                    evt = {"name": f"{'W' if flags & MMIO_WRITE else 'R'} 0x{addr:x}",
+                           "ph": "i", "s": "t", "pid": 1, "tid": tid, "ts": us(ticks),
+                           "args": {"pc": f"0x{pc:x}", "data": f"0x{data:x}", "width": width}}
+                elif rec == REC_BEGIN:
+                    evt = {"name": r[3], "ph": "B", "pid": 1, "tid": tid, "ts": us(r[2])}
+                elif rec == REC_END:
+                    evt = {"ph": "E", "pid": 1, "tid": tid, "ts": us(r[2])}
+                else:
+                    evt = {"name": r[3], "ph": "i", "s": "t", "pid": 1, "tid": tid,
+                           "ts": us(r[2])}
+            out.write(",\n" + json.dumps(evt, separators=(",", ":")))
+        out.write("\n]}\n")
+
+if __name__ == "__main__":
+    if len(sys.argv) != 3:
+        print(f"Usage: {sys.argv[0]} trace.m1trace trace.json")
+        sys.exit(1)
+    convert(sys.argv[1], sys.argv[2])
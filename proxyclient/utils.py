@@ -1,57 +1,59 @@
 #!/usr/bin/env python3
 # SPDX-License-Identifier: MIT
 
+import struct
 from enum import Enum
-from construct import Adapter, Int64ul, Int32ul, Int16ul, Int8ul
+from construct import (Adapter, Int64ul, Int32ul, Int16ul, Int8ul, Array, Container,
+                       FormatField, ListContainer, Padded, Pass, Renamed, Struct)
 
 def align(v, a=16384):
     return (v + a - 1) & ~(a - 1)
 
 class Register:
+    # name -> (lsb, mask, type or None), or None for an invalid definition; built per class
+    _field_table = {}
+
+    def __init_subclass__(cls, **kwargs):
+        super().__init_subclass__(**kwargs)
+        table = {}
+        for k, field in cls.__dict__.items():
+            if k == "value" or k.startswith("_"):
+                continue
+            if isinstance(field, int):
+                table[k] = (field, 1, None)
+            elif isinstance(field, tuple):
+                msb, lsb = field[:2]
+                table[k] = (lsb, (1 << ((msb + 1) - lsb)) - 1, field[2] if len(field) > 2 else None)
+            else:
+                table[k] = None
+        cls._field_table = table
+
     def __init__(self, v=0, **kwargs):
         self.value = v
         for k,v in kwargs.items():
             setattr(self, k, v)
 
     def __getattribute__(self, attr):
-        if attr.startswith("_") or attr not in self._fields:
+        field = type(self)._field_table.get(attr, False)
+        if field is False:
             return object.__getattribute__(self, attr)
+        if field is None:
+            raise AttributeError(f"Invalid field definition {attr} = {getattr(type(self), attr)!r}")
 
-        field = getattr(self.__class__, attr)
-        value = self.value
-
-        if isinstance(field, int):
-            return (value >> field) & 1
-        elif isinstance(field, tuple):
-            if len(field) == 2:
-                msb, lsb = field
-                ftype = int
-            else:
-                msb, lsb, ftype = field
-            return ftype((value >> lsb) & ((1 << ((msb + 1) - lsb)) - 1))
-        else:
-            raise AttributeError(f"Invalid field definition {attr} = {field!r}")
+        lsb, mask, ftype = field
+        value = (object.__getattribute__(self, "value") >> lsb) & mask
+        return value if ftype is None else ftype(value)
 
     def __setattr__(self, attr, fvalue):
-        if attr not in self._fields:
+        field = type(self)._field_table.get(attr, False)
+        if field is False:
             self.__dict__[attr] = fvalue
             return
+        if field is None:
+            raise AttributeError(f"Invalid field definition {attr} = {getattr(type(self), attr)!r}")
 
-        field = getattr(self.__class__, attr)
-
-        value = self.value
-
-        if isinstance(field, int):
-            self.value = (value & ~(1 << field)) | ((fvalue & 1) << field)
-        elif isinstance(field, tuple):
-            if len(field) == 2:
-                msb, lsb = field
-            else:
-                msb, lsb, ftype = field
-            mask = ((1 << ((msb + 1) - lsb)) - 1)
-            self.value = (value & ~(mask << lsb)) | ((fvalue & mask) << lsb)
-        else:
-            raise AttributeError(f"Invalid field definition {attr} = {field!r}")
+        lsb, mask, ftype = field
+        self.value = (self.value & ~(mask << lsb)) | ((fvalue & mask) << lsb)
 
     @property
     def _fields(self):
@@ -120,3 +122,86 @@ class RegAdapter(Adapter):
 
     def _encode(self, obj, context, path):
         return obj.value
+
+class FastStruct:
+    """Precompiled parser/builder for a fixed-layout construct Struct.
+
+    The construct definition stays the source of truth: its fields are compiled once into a
+    single struct.Struct plus generated code that rebuilds the same Containers, which is far
+    cheaper than construct's per-field parsing for structs decoded on every guest exit.
+    Integer fields, fixed-size integer arrays, padding and nested structs are handled
+    natively, adapters (Hex, RegAdapter, enums) are applied to the raw values, and any other
+    fixed-size field is passed through its own construct. Anything else (including the
+    original Struct, for nesting) is available as .subcon.
+    """
+    def __init__(self, subcon):
+        self.subcon = subcon
+        self._ns = {"Container": Container, "ListContainer": ListContainer}
+        fmt, n, parse, build = self._compile(subcon)
+        self._struct = st = struct.Struct("<" + fmt)
+        assert st.size == subcon.sizeof()
+        self._ns.update(unpack_from=st.unpack_from, pack=st.pack)
+        exec(f"def parse(data, offset=0):\n"
+             f"    v = unpack_from(data, offset)\n"
+             f"    return {parse(0)}\n"
+             f"def build(obj):\n"
+             f"    return pack({', '.join(build('obj'))})\n", self._ns)
+        self.parse = self._ns["parse"]
+        self.build = self._ns["build"]
+
+    def sizeof(self):
+        return self._struct.size
+
+    def _obj(self, sc):
+        name = f"_sc{len(self._ns)}"
+        self._ns[name] = sc
+        return name
+
+    def _compile(self, sc):
+        # Returns (format, value count, index -> parse expression, obj -> build expressions)
+        if isinstance(sc, FormatField) and sc.fmtstr[0] == "<":
+            return sc.fmtstr[1:], 1, lambda i: f"v[{i}]", lambda o: [o]
+
+        if (isinstance(sc, Array) and isinstance(sc.count, int) and
+            isinstance(sc.subcon, FormatField) and sc.subcon.fmtstr[0] == "<"):
+            n = sc.count
+            return (f"{n}{sc.subcon.fmtstr[1:]}", n,
+                    lambda i: f"ListContainer(v[{i}:{i + n}])", lambda o: [f"*{o}"])
+
+        if isinstance(sc, Padded) and sc.subcon is Pass and isinstance(sc.length, int):
+            return f"{sc.length}x", 0, None, lambda o: []
+
+        if isinstance(sc, Adapter):
+            fmt, n, parse, build = self._compile(sc.subcon)
+            if n == 1 and parse is not None:
+                a = self._obj(sc)
+                return (fmt, 1, lambda i: f"{a}._decode({parse(i)}, None, None)",
+                        lambda o: build(f"{a}._encode({o}, None, None)"))
+
+        elif isinstance(sc, Struct):
+            fmt, count, fields, builds = "", 0, [], []
+            for sub in sc.subcons:
+                name = sub.name if isinstance(sub, Renamed) else None
+                f, n, parse, build = self._compile(sub.subcon if name else sub)
+                if name is not None and parse is not None:
+                    fields.append((name, parse, count))
+                    builds.append(lambda o, name=name, build=build: build(f"{o}[{name!r}]"))
+                else:
+                    builds.append(lambda o, build=build: build("None"))
+                fmt += f
+                count += n
+            return (fmt, count,
+                    lambda i: "Container({%s})" % ", ".join(f"{name!r}: {parse(i + off)}"
+                                                           for name, parse, off in fields),
+                    lambda o: [e for b in builds for e in b(o)])
+
+        # Anything else of fixed size goes through construct on its slice of the data
+        a = self._obj(sc)
+        return (f"{sc.sizeof()}s", 1, lambda i: f"{a}.parse(v[{i}])",
+                lambda o: [f"{a}.build({o})"])
+
+    def sizeof(self):
+        return self._struct.size
+
+    def __getattr__(self, attr):
+        return getattr(self.subcon, attr)
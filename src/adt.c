@@ -341,3 +341,157 @@ int adt_get_reg(const void *adt, int *path, const char *prop, int idx, u64 *padd
 
     return 0;
 }
+
+/* Write support, loosely modeled after libfdt's fdt_setprop()/fdt_delprop()/fdt_del_node() */
+
+int adt_get_size(const void *adt)
+{
+    ADT_CHECK_HEADER(adt);
+
+    return adt_next_sibling_offset(adt, 0);
+}
+
+static int _adt_prop_size(u32 len)
+{
+    return sizeof(struct adt_property) + ((len + ADT_ALIGN - 1) & ~(ADT_ALIGN - 1));
+}
+
+/*
+ * Resize the region at offset from oldlen to newlen bytes, moving everything after it. Space
+ * freed at the end of the tree is zeroed so the blob stays identical to a fresh build.
+ */
+static int _adt_splice(void *adt, size_t bufsize, int offset, int oldlen, int newlen)
+{
+    int size = adt_get_size(adt);
+    u8 *p = (u8 *)adt + offset;
+
+    if (size < 0)
+        return size;
+
+    if ((size_t)(size - oldlen + newlen) > bufsize)
+        return -ADT_ERR_NOSPACE;
+
+    if (oldlen != newlen)
+        memmove(p + newlen, p + oldlen, size - offset - oldlen);
+    if (newlen < oldlen)
+        memset((u8 *)adt + size - (oldlen - newlen), 0, oldlen - newlen);
+
+    return size - oldlen + newlen;
+}
+
+int adt_setprop(void *adt, size_t bufsize, int nodeoffset, const char *name, const void *value,
+                size_t len)
+{
+    struct adt_node_hdr *node = (struct adt_node_hdr *)ADT_NODE(adt, nodeoffset);
+    struct adt_property *prop;
+    int offset, oldlen, size;
+    u32 flags = 0;
+
+    ADT_CHECK_HEADER(adt);
+
+    if (strlen(name) >= sizeof(prop->name))
+        return -ADT_ERR_BADVALUE;
+    if (len & 0x7ff00000)
+        return -ADT_ERR_BADLENGTH;
+
+    prop = (struct adt_property *)adt_get_property(adt, nodeoffset, name);
+    if (prop) {
+        offset = (u8 *)prop - (u8 *)adt;
+        oldlen = _adt_prop_size(ADT_SIZE(prop));
+        // Bit 31 of the size is a flag, not part of the length; keep it across the rewrite
+        flags = prop->size & 0x80000000;
+    } else {
+        offset = adt_first_child_offset(adt, nodeoffset);
+        oldlen = 0;
+    }
+
+    size = _adt_splice(adt, bufsize, offset, oldlen, _adt_prop_size(len));
+    if (size < 0)
+        return size;
+
+    prop = (struct adt_property *)ADT_PROP(adt, offset);
+    if (!oldlen) {
+        memset(prop->name, 0, sizeof(prop->name));
+        strcpy(prop->name, name);
+        node->property_count++;
+    }
+    prop->size = flags | len;
+    memcpy(prop->value, value, len);
+    memset(prop->value + len, 0, _adt_prop_size(len) - sizeof(*prop) - len);
+
+    return size;
+}
+
+int adt_delprop(void *adt, int nodeoffset, const char *name)
+{
+    struct adt_node_hdr *node = (struct adt_node_hdr *)ADT_NODE(adt, nodeoffset);
+    const struct adt_property *prop;
+
+    ADT_CHECK_HEADER(adt);
+
+    prop = adt_get_property(adt, nodeoffset, name);
+    if (!prop)
+        return -ADT_ERR_NOTFOUND;
+
+    // Nodes without properties are rejected by the sanity checks, and every node needs a name
+    if (node->property_count == 1 || !strcmp(name, "name"))
+        return -ADT_ERR_BADVALUE;
+
+    int size = _adt_splice(adt, ~0UL, (u8 *)prop - (u8 *)adt, _adt_prop_size(ADT_SIZE(prop)), 0);
+    if (size < 0)
+        return size;
+
+    node->property_count--;
+    return size;
+}
+
+int adt_path_offset_parent(const void *adt, const char *path, int *parentoffset)
+{
+    const char *end = path + strlen(path);
+    const char *p = path;
+    int offset = 0, parent = -ADT_ERR_BADPATH;
+
+    ADT_CHECK_HEADER(adt);
+
+    while (*p) {
+        const char *q;
+
+        while (*p == '/')
+            p++;
+        if (!*p)
+            break;
+        q = strchr(p, '/');
+        if (!q)
+            q = end;
+
+        parent = offset;
+        offset = adt_subnode_offset_namelen(adt, offset, p, q - p);
+        if (offset < 0)
+            return offset;
+
+        p = q;
+    }
+
+    if (parentoffset)
+        *parentoffset = parent;
+
+    return offset;
+}
+
+int adt_del_node(void *adt, int parentoffset, int nodeoffset)
+{
+    struct adt_node_hdr *parent = (struct adt_node_hdr *)ADT_NODE(adt, parentoffset);
+
+    ADT_CHECK_HEADER(adt);
+
+    if (!nodeoffset || !parent->child_count)
+        return -ADT_ERR_BADOFFSET;
+
+    int len = adt_next_sibling_offset(adt, nodeoffset) - nodeoffset;
+    int size = _adt_splice(adt, ~0UL, nodeoffset, len, 0);
+    if (size < 0)
+        return size;
+
+    parent->child_count--;
+    return size;
+}
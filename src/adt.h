@@ -9,6 +9,7 @@
 #include "types.h"
 
 #define ADT_ERR_NOTFOUND  1
+#define ADT_ERR_NOSPACE   3
 #define ADT_ERR_BADOFFSET 4
 #define ADT_ERR_BADPATH   5
 #define ADT_ERR_BADNCELLS 14
@@ -53,7 +54,8 @@ static inline int adt_first_property_offset(const void *adt, int offset)
 static inline int adt_next_property_offset(const void *adt, int offset)
 {
     const struct adt_property *prop = ADT_PROP(adt, offset);
-    return offset + sizeof(struct adt_property) + ((prop->size + ADT_ALIGN - 1) & ~(ADT_ALIGN - 1));
+    return offset + sizeof(struct adt_property) +
+           ((ADT_SIZE(prop) + ADT_ALIGN - 1) & ~(ADT_ALIGN - 1));
 }
 
 static inline const struct adt_property *adt_get_property_by_offset(const void *adt, int offset)
@@ -92,6 +94,18 @@ int adt_getprop_copy(const void *adt, int nodeoffset, const char *name, void *ou
 
 int adt_get_reg(const void *adt, int *path, const char *prop, int idx, u64 *addr, u64 *size);
 
+/*
+ * In-place editing. These return the new total size of the tree or a negative error. bufsize
+ * is the space available at adt; properties are rewritten in place when their padded size
+ * does not change, otherwise the rest of the tree is moved up or down.
+ */
+int adt_get_size(const void *adt);
+int adt_setprop(void *adt, size_t bufsize, int nodeoffset, const char *name, const void *value,
+                size_t len);
+int adt_delprop(void *adt, int nodeoffset, const char *name);
+int adt_path_offset_parent(const void *adt, const char *path, int *parentoffset);
+int adt_del_node(void *adt, int parentoffset, int nodeoffset);
+
 #define ADT_FOREACH_CHILD(adt, node)                                                               \
     for (int _child_count = adt_get_child_count(adt, node); _child_count; _child_count = 0)        \
         for (node = adt_first_child_offset(adt, node); _child_count--;                             \
@@ -0,0 +1,178 @@
+/* SPDX-License-Identifier: MIT */
+
+#include "aic.h"
+#include "adt.h"
+#include "types.h"
+#include "utils.h"
+
+#define AIC_INFO          0x0004
+#define AIC_INFO_NR_HW    GENMASK(15, 0)
+#define AIC_WHOAMI        0x2000
+#define AIC_EVENT         0x2004
+#define AIC_EVENT_TYPE    GENMASK(31, 16)
+#define AIC_EVENT_NUM     GENMASK(15, 0)
+#define AIC_IPI_SEND      0x2008
+#define AIC_IPI_ACK       0x200c
+#define AIC_IPI_MASK_SET  0x2024
+#define AIC_IPI_MASK_CLR  0x2028
+#define AIC_TARGET_CPU(i) (0x3000 + 4 * (i))
+#define AIC_SW_CLR(i)     (0x4080 + 4 * ((i) >> 5))
+#define AIC_MASK_SET(i)   (0x4100 + 4 * ((i) >> 5))
+#define AIC_MASK_CLR(i)   (0x4180 + 4 * ((i) >> 5))
+#define AIC_IRQ_BIT(i)    BIT((i)&0x1f)
+
+#define AIC_EVENT_TYPE_HW  1
+#define AIC_EVENT_TYPE_IPI 4
+
+#define AIC_IPI_OTHER BIT(0)
+#define AIC_IPI_SELF  BIT(31)
+
+#define AIC_MAX_IRQS 1024
+
+struct aic_irq {
+    aic_handler_t handler;
+    void *opaque;
+};
+
+static u64 aic_base;
+static u32 aic_nr_irqs;
+static struct aic_irq aic_irqs[AIC_MAX_IRQS];
+static aic_ipi_handler_t aic_ipi_handler;
+
+int aic_init(void)
+{
+    int path[8];
+    int node = adt_path_offset_trace(adt, "/arm-io/aic", path);
+
+    if (node < 0) {
+        printf("AIC: Error getting /arm-io/aic node\n");
+        return -1;
+    }
+
+    if (adt_get_reg(adt, path, "reg", 0, &aic_base, NULL)) {
+        printf("AIC: Error getting AIC reg property\n");
+        return -1;
+    }
+
+    aic_nr_irqs = min(FIELD_GET(AIC_INFO_NR_HW, read32(aic_base + AIC_INFO)), AIC_MAX_IRQS);
+
+    for (u32 i = 0; i < aic_nr_irqs; i += 32) {
+        write32(aic_base + AIC_MASK_SET(i), ~0);
+        write32(aic_base + AIC_SW_CLR(i), ~0);
+    }
+
+    aic_init_cpu();
+
+    printf("AIC registers @ 0x%lx, %d IRQs\n", aic_base, aic_nr_irqs);
+
+    return 0;
+}
+
+void aic_init_cpu(void)
+{
+    if (!aic_base)
+        return;
+
+    write32(aic_base + AIC_IPI_ACK, AIC_IPI_OTHER | AIC_IPI_SELF);
+    write32(aic_base + AIC_IPI_MASK_CLR, AIC_IPI_OTHER);
+}
+
+void aic_shutdown(void)
+{
+    if (!aic_base)
+        return;
+
+    for (u32 i = 0; i < aic_nr_irqs; i += 32)
+        write32(aic_base + AIC_MASK_SET(i), ~0);
+    write32(aic_base + AIC_IPI_MASK_SET, AIC_IPI_OTHER | AIC_IPI_SELF);
+
+    for (u32 i = 0; i < aic_nr_irqs; i++)
+        aic_irqs[i].handler = NULL;
+    aic_ipi_handler = NULL;
+    aic_base = 0;
+}
+
+bool aic_is_initialized(void)
+{
+    return aic_base != 0;
+}
+
+int aic_set_handler(u32 irq, aic_handler_t handler, void *opaque)
+{
+    if (!aic_base || irq >= aic_nr_irqs)
+        return -1;
+
+    aic_mask(irq);
+
+    aic_irqs[irq].opaque = opaque;
+    aic_irqs[irq].handler = handler;
+    sysop("dmb sy");
+
+    if (handler) {
+        write32(aic_base + AIC_TARGET_CPU(irq), BIT(read32(aic_base + AIC_WHOAMI)));
+        aic_unmask(irq);
+    }
+
+    return 0;
+}
+
+void aic_mask(u32 irq)
+{
+    if (aic_base && irq < aic_nr_irqs)
+        write32(aic_base + AIC_MASK_SET(irq), AIC_IRQ_BIT(irq));
+}
+
+void aic_unmask(u32 irq)
+{
+    if (aic_base && irq < aic_nr_irqs)
+        write32(aic_base + AIC_MASK_CLR(irq), AIC_IRQ_BIT(irq));
+}
+
+void aic_set_ipi_handler(aic_ipi_handler_t handler)
+{
+    aic_ipi_handler = handler;
+}
+
+void aic_send_ipi(int cpu)
+{
+    if (aic_base)
+        write32(aic_base + AIC_IPI_SEND, BIT(cpu));
+}
+
+/*
+ * Called from the IRQ vector. Reading AIC_EVENT acknowledges the event and masks its source;
+ * returns false if there was nothing for us (AIC not set up, or a spurious/unknown event).
+ */
+bool aic_handle_irq(void)
+{
+    bool handled = false;
+
+    if (!aic_base)
+        return false;
+
+    while (true) {
+        u32 event = read32(aic_base + AIC_EVENT);
+        u32 type = FIELD_GET(AIC_EVENT_TYPE, event);
+        u32 num = FIELD_GET(AIC_EVENT_NUM, event);
+
+        if (!event)
+            break;
+
+        if (type == AIC_EVENT_TYPE_HW && num < aic_nr_irqs && aic_irqs[num].handler) {
+            aic_irqs[num].handler(aic_irqs[num].opaque, num);
+            aic_unmask(num);
+        } else if (type == AIC_EVENT_TYPE_IPI) {
+            write32(aic_base + AIC_IPI_ACK, num == 1 ? AIC_IPI_OTHER : AIC_IPI_SELF);
+            if (aic_ipi_handler)
+                aic_ipi_handler();
+            write32(aic_base + AIC_IPI_MASK_CLR, num == 1 ? AIC_IPI_OTHER : AIC_IPI_SELF);
+        } else {
+            printf("AIC: unhandled event type %d num %d, leaving it masked\n", type, num);
+            return handled;
+        }
+
+        handled = true;
+    }
+
+    return handled;
+}
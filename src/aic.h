@@ -0,0 +1,31 @@
+/* SPDX-License-Identifier: MIT */
+
+#ifndef AIC_H
+#define AIC_H
+
+#include "types.h"
+
+/*
+ * Handlers run in IRQ context on the CPU the interrupt is routed to (the one that called
+ * aic_set_handler()), with the IRQ masked in the AIC. It is unmasked again when the handler
+ * returns, so level-triggered sources must be quiesced by then.
+ */
+typedef void (*aic_handler_t)(void *opaque, u32 irq);
+typedef void (*aic_ipi_handler_t)(void);
+
+int aic_init(void);
+void aic_init_cpu(void);
+void aic_shutdown(void);
+
+bool aic_is_initialized(void);
+
+int aic_set_handler(u32 irq, aic_handler_t handler, void *opaque);
+void aic_mask(u32 irq);
+void aic_unmask(u32 irq);
+
+void aic_set_ipi_handler(aic_ipi_handler_t handler);
+void aic_send_ipi(int cpu);
+
+bool aic_handle_irq(void);
+
+#endif
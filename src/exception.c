@@ -1,6 +1,7 @@
 /* SPDX-License-Identifier: MIT */
 
 #include "exception.h"
+#include "aic.h"
 #include "cpu_regs.h"
 #include "gxf.h"
 #include "iodev.h"
@@ -16,7 +17,7 @@ void *el0_stack_base = (void *)(u64)(&el0_stack[EL0_STACK_SIZE]);
 extern char _vectors_start[0];
 extern char _el1_vectors_start[0];
 
-volatile enum exc_guard_t exc_guard = GUARD_OFF;
+volatile enum exc_guard_t exc_guards[MAX_CPUS];
 volatile int exc_count = 0;
 
 void el0_ret(void);
@@ -248,6 +249,9 @@ void exc_sync(u64 *regs)
     if (!(exc_guard & GUARD_SILENT))
         print_regs(regs, el12);
 
+    // GUARD_RETURN clears the guard, remember whether to be quiet about recovering
+    bool silent = exc_guard & GUARD_SILENT;
+
     switch (exc_guard & GUARD_TYPE_MASK) {
         case GUARD_SKIP:
             elr = mrs(ELR_EL1) + 4;
@@ -270,7 +274,7 @@ void exc_sync(u64 *regs)
 
     exc_count++;
 
-    if (!(exc_guard & GUARD_SILENT))
+    if (!silent)
         printf("Recovering from exception (ELR=0x%lx)\n", elr);
     msr(ELR_EL1, elr);
 
@@ -280,6 +284,11 @@ void exc_sync(u64 *regs)
 
 void exc_irq(u64 *regs)
 {
+    if (aic_is_initialized()) {
+        aic_handle_irq();
+        return;
+    }
+
 #ifdef DEBUG_UART_IRQS
     u32 ucon, utrstat, uerstat, ufstat;
     ucon = read32(0x235200004);
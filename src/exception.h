@@ -5,6 +5,7 @@
 
 #include <stdint.h>
 
+#include "smp.h"
 #include "types.h"
 
 enum exc_guard_t {
@@ -16,7 +17,10 @@ enum exc_guard_t {
     GUARD_SILENT = 0x100,
 };
 
-extern volatile enum exc_guard_t exc_guard;
+// Each CPU has its own guard, so a secondary running offloaded work cannot catch the boot CPU's
+// faults or the other way around
+extern volatile enum exc_guard_t exc_guards[MAX_CPUS];
+#define exc_guard (exc_guards[smp_id()])
 extern volatile int exc_count;
 
 void exception_initialize(void);
@@ -4,6 +4,7 @@
 #include "assert.h"
 #include "iodev.h"
 #include "malloc.h"
+#include "simd.h"
 #include "string.h"
 #include "types.h"
 #include "utils.h"
@@ -82,8 +83,11 @@ static void fb_move_font_row(u32 dst, u32 src)
     ysrc *= fb.stride;
     ydst *= fb.stride;
 
-    for (u32 y = 0; y < console.font.height; ++y)
-        memcpy(fb.ptr + ydst + y * fb.stride, fb.ptr + ysrc + y * fb.stride, row_size);
+    if (!simd_copy_rect(fb.ptr + ydst, fb.stride * 4, fb.ptr + ysrc, fb.stride * 4, row_size,
+                        console.font.height)) {
+        for (u32 y = 0; y < console.font.height; ++y)
+            memcpy(fb.ptr + ydst + y * fb.stride, fb.ptr + ysrc + y * fb.stride, row_size);
+    }
 
     fb_clear_font_row(src);
 }
@@ -112,6 +116,9 @@ void fb_blit(u32 x, u32 y, u32 w, u32 h, void *data, u32 stride)
 {
     u8 *p = data;
 
+    if (simd_rgba_to_fb30(&fb.ptr[x + y * fb.stride], fb.stride, data, stride, w, h))
+        return;
+
     for (u32 i = 0; i < h; i++) {
         for (u32 j = 0; j < w; j++) {
             rgb_t color = {.r = p[(j + i * stride) * 4],
@@ -126,6 +133,9 @@ void fb_unblit(u32 x, u32 y, u32 w, u32 h, void *data, u32 stride)
 {
     u8 *p = data;
 
+    if (simd_fb30_to_rgba(data, stride, &fb.ptr[x + y * fb.stride], fb.stride, w, h))
+        return;
+
     for (u32 i = 0; i < h; i++) {
         for (u32 j = 0; j < w; j++) {
             rgb_t color = fb_get_pixel(x + j, y + i);
@@ -4,6 +4,7 @@
 #include "exception.h"
 #include "gxf.h"
 #include "memory.h"
+#include "string.h"
 #include "uart.h"
 #include "utils.h"
 
@@ -91,3 +92,105 @@ uint64_t gl1_call(void *func, uint64_t a, uint64_t b, uint64_t c, uint64_t d)
 
     return ret;
 }
+
+#define SPRR_PROBE_DATA 0x20
+
+static void sprr_set_perm(u64 perm)
+{
+    msr_sync(SYS_IMP_APL_SPRR_PERM_EL1, perm);
+    sysop("dsb ishst");
+    sysop("tlbi vmalle1is");
+    sysop("dsb ish");
+    sysop("isb");
+}
+
+/*
+ * Try reading, writing and executing (a ret stub) a test page. This runs both at EL and GL;
+ * faults are counted and skipped by the exception guard.
+ */
+static uint64_t sprr_probe(uint64_t va)
+{
+    uint64_t ret = 0;
+    int count;
+
+    exc_guard = GUARD_SKIP | GUARD_SILENT;
+    count = exc_count;
+    read32(va);
+    if (exc_count == count)
+        ret |= SPRR_SWEEP_R;
+
+    count = exc_count;
+    write32(va + SPRR_PROBE_DATA, 0);
+    if (exc_count == count)
+        ret |= SPRR_SWEEP_W;
+
+    // A fetch fault would just repeat with GUARD_SKIP, so return from the stub instead
+    exc_guard = GUARD_RETURN | GUARD_SILENT;
+    count = exc_count;
+    ((void (*)(void))va)();
+    if (exc_count == count)
+        ret |= SPRR_SWEEP_X;
+
+    exc_guard = GUARD_OFF;
+    return ret;
+}
+
+/*
+ * Run the SPRR permission matrix on the target: for every index in indices and every
+ * permission value in values (both bitmasks), set that nibble of SPRR_PERM and probe the
+ * matching alias of page (see mmu_map_sprr_test()) at EL and GL. results is a 16x16 table
+ * indexed by [index][value]; untested entries are SPRR_SWEEP_SKIPPED. Indices that m1n1 itself
+ * runs from are refused. Returns the number of combinations tested.
+ */
+int gxf_sprr_sweep(u64 page, u16 indices, u16 values, u8 *results)
+{
+    int count = 0;
+
+    if (indices & mmu_sprr_used_indices())
+        return -1;
+    if (mmu_map_sprr_test(page) < 0)
+        return -1;
+
+    write32(page, 0xd65f03c0); // ret
+    dc_cvau_range((void *)page, 4);
+    ic_ivau_range((void *)page, 4);
+    sysop("dsb ish");
+    sysop("isb");
+
+    memset(results, SPRR_SWEEP_SKIPPED, 16 * 16);
+
+    // Nothing else may run while the permissions are in flux
+    u64 daif = mrs(DAIF);
+    msr(DAIF, daif | (7 << 6));
+
+    enum exc_guard_t guard = exc_guard;
+    u64 sprr_state = mrs(SYS_IMP_APL_SPRR_CONFIG_EL1);
+    reg_set_sync(SYS_IMP_APL_SPRR_CONFIG_EL1, SPRR_CONFIG_EN);
+    u64 perm = mrs(SYS_IMP_APL_SPRR_PERM_EL1);
+
+    for (int idx = 0; idx < 16; idx++) {
+        if (!(indices & BIT(idx)))
+            continue;
+
+        for (int val = 0; val < 16; val++) {
+            if (!(values & BIT(val)))
+                continue;
+
+            sprr_set_perm((perm & ~(0xfUL << (4 * idx))) | ((u64)val << (4 * idx)));
+
+            u64 el = sprr_probe(SPRR_TEST_PAGE(idx));
+            u64 gl = in_el2() ? gl2_call(sprr_probe, SPRR_TEST_PAGE(idx), 0, 0, 0)
+                              : gl1_call(sprr_probe, SPRR_TEST_PAGE(idx), 0, 0, 0);
+
+            results[idx * 16 + val] = el | ((gl & 7) << 3);
+            count++;
+        }
+    }
+
+    sprr_set_perm(perm);
+    msr_sync(SYS_IMP_APL_SPRR_CONFIG_EL1, sprr_state);
+    exc_guard = guard;
+    msr(DAIF, daif);
+
+    return count;
+}
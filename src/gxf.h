@@ -11,4 +11,15 @@ void gxf_init(void);
 uint64_t gl1_call(void *func, uint64_t a, uint64_t b, uint64_t c, uint64_t d);
 uint64_t gl2_call(void *func, uint64_t a, uint64_t b, uint64_t c, uint64_t d);
 
+/* Result bits of gxf_sprr_sweep(), per (permission index, permission value) */
+#define SPRR_SWEEP_R       BIT(0)
+#define SPRR_SWEEP_W       BIT(1)
+#define SPRR_SWEEP_X       BIT(2)
+#define SPRR_SWEEP_GL_R    BIT(3)
+#define SPRR_SWEEP_GL_W    BIT(4)
+#define SPRR_SWEEP_GL_X    BIT(5)
+#define SPRR_SWEEP_SKIPPED 0xff
+
+int gxf_sprr_sweep(u64 page, u16 indices, u16 values, u8 *results);
+
 #endif
@@ -0,0 +1,250 @@
+/* SPDX-License-Identifier: MIT */
+
+#include "gzip.h"
+#include "memory.h"
+#include "offload.h"
+#include "sched.h"
+#include "string.h"
+#include "utils.h"
+
+#include "tinf/tinf.h"
+
+#define GZIP_HDR_LEN     10
+#define GZIP_TRAILER_LEN 8
+#define GZIP_FLG_FEXTRA  BIT(2)
+
+// A member table entry: compressed size, then uncompressed size
+#define GZIP_ENTRY_LEN 8
+
+static u32 gzip_le16(const u8 *p)
+{
+    return p[0] | (p[1] << 8);
+}
+
+static u32 gzip_le32(const u8 *p)
+{
+    return p[0] | (p[1] << 8) | (p[2] << 16) | ((u32)p[3] << 24);
+}
+
+// Returns the member table subfield data in the first member's header, or NULL if there is none
+static const u8 *gzip_find_table(const u8 *src, size_t src_len, u32 *table_len)
+{
+    const u8 *p, *end;
+
+    if (src_len && src_len < GZIP_HDR_LEN + 2)
+        return NULL;
+    if (src[0] != 0x1f || src[1] != 0x8b || src[2] != 8 || !(src[3] & GZIP_FLG_FEXTRA))
+        return NULL;
+
+    p = src + GZIP_HDR_LEN + 2;
+    end = p + gzip_le16(src + GZIP_HDR_LEN);
+    if (src_len && end > src + src_len)
+        return NULL;
+
+    while (p + 4 <= end) {
+        u32 len = gzip_le16(p + 2);
+
+        if (p + 4 + len > end)
+            return NULL;
+        if (p[0] == GZIP_TABLE_SI1 && p[1] == GZIP_TABLE_SI2) {
+            *table_len = len;
+            return p + 4;
+        }
+        p += 4 + len;
+    }
+
+    return NULL;
+}
+
+/*
+ * Returns 1 if src is a multi-member stream with a valid member table, 0 if it is an ordinary
+ * gzip stream to be decompressed serially, and a TINF error if the table does not add up. A
+ * src_len of 0 means the size is unknown, and is then taken from the table.
+ */
+int gzip_par_init(struct gzip_par *par, void *dest, size_t dest_len, const void *src,
+                  size_t src_len)
+{
+    const u8 *table;
+    u32 table_len, count;
+    u64 csum = 0, usum = 0;
+
+    memset(par, 0, sizeof(*par));
+
+    table = gzip_find_table(src, src_len, &table_len);
+    if (!table || table_len < 4)
+        return 0;
+
+    count = gzip_le32(table);
+    if (count < 2)
+        return 0;
+    if (table_len < 4 + (u64)count * GZIP_ENTRY_LEN)
+        return TINF_DATA_ERROR;
+
+    for (u32 i = 0; i < count; i++) {
+        u32 csize = gzip_le32(table + 4 + i * GZIP_ENTRY_LEN);
+
+        if (csize < GZIP_HDR_LEN + GZIP_TRAILER_LEN)
+            return TINF_DATA_ERROR;
+        csum += csize;
+        usum += gzip_le32(table + 8 + i * GZIP_ENTRY_LEN);
+    }
+
+    if (csum > 0xffffffff || (src_len && csum != src_len))
+        return TINF_DATA_ERROR;
+    if (usum > dest_len || usum > 0xffffffff)
+        return TINF_BUF_ERROR;
+
+    par->src = src;
+    par->dest = dest;
+    par->table = table + 4;
+    par->count = count;
+    par->src_len = csum;
+    par->dest_len = usum;
+
+    return 1;
+}
+
+static int gzip_par_member(struct gzip_par_worker *worker, u32 i, const u8 *src, u8 *dest)
+{
+    struct gzip_par *par = worker->par;
+    u32 usize = gzip_le32(par->table + i * GZIP_ENTRY_LEN + 4);
+    unsigned int src_len = gzip_le32(par->table + i * GZIP_ENTRY_LEN), dest_len = usize;
+    int ret = tinf_gzip_uncompress(dest, &dest_len, src, &src_len);
+
+    if (ret != TINF_OK)
+        return ret;
+    if (dest_len != usize)
+        return TINF_DATA_ERROR;
+
+    worker->progress += usize;
+    return TINF_OK;
+}
+
+/*
+ * Members are dealt out round-robin, so each worker walks the whole table to find its output
+ * offsets and no shared state is needed between the cores.
+ */
+static int gzip_par_decode(struct gzip_par_worker *worker, u32 stride)
+{
+    struct gzip_par *par = worker->par;
+    const u8 *src = par->src;
+    u8 *dest = par->dest;
+
+    for (u32 i = 0; i < par->count; i++) {
+        if (i % stride == worker->index) {
+            int ret = gzip_par_member(worker, i, src, dest);
+
+            if (ret != TINF_OK)
+                return ret;
+        }
+
+        src += gzip_le32(par->table + i * GZIP_ENTRY_LEN);
+        dest += gzip_le32(par->table + i * GZIP_ENTRY_LEN + 4);
+    }
+
+    return TINF_OK;
+}
+
+// Without secondaries, the calling CPU decompresses one member per gzip_par_poll()
+static void gzip_par_step(struct gzip_par *par)
+{
+    u32 i = par->next++;
+
+    par->serial_ret =
+        gzip_par_member(&par->worker[0], i, par->src + par->src_off, par->dest + par->dest_off);
+    par->src_off += gzip_le32(par->table + i * GZIP_ENTRY_LEN);
+    par->dest_off += gzip_le32(par->table + i * GZIP_ENTRY_LEN + 4);
+}
+
+static u64 gzip_par_trampoline(u64 worker_addr, u64 stride)
+{
+    struct gzip_par_worker *worker = (struct gzip_par_worker *)worker_addr;
+
+    // See offload_trampoline()
+    mmu_init_secondary();
+    int ret = gzip_par_decode(worker, stride);
+    mmu_disable();
+
+    return ret;
+}
+
+/*
+ * Starts decompressing on all idle Firestorm cores. If there are none, gzip_par_poll()
+ * decompresses the members on the calling CPU, one per call.
+ */
+void gzip_par_start(struct gzip_par *par)
+{
+    int cpus[MAX_CPUS];
+    int count = offload_get_cpus(cpus, min(par->count, (u32)MAX_CPUS));
+
+    for (int i = 0; i < max(count, 1); i++) {
+        par->worker[i].par = par;
+        par->worker[i].index = i;
+        par->worker[i].cpu = count ? cpus[i] : -1;
+        par->worker[i].progress = 0;
+    }
+    par->workers = max(count, 1);
+    par->next = par->src_off = par->dest_off = 0;
+    par->serial_ret = TINF_OK;
+
+    if (!count)
+        return;
+
+    sysop("dmb sy");
+    for (int i = 0; i < count; i++)
+        smp_call4(cpus[i], (void *)gzip_par_trampoline, (u64)&par->worker[i], count, 0, 0);
+}
+
+// Returns true while members are still being decompressed
+bool gzip_par_poll(struct gzip_par *par)
+{
+    if (par->worker[0].cpu < 0) {
+        if (par->serial_ret == TINF_OK && par->next < par->count)
+            gzip_par_step(par);
+        return par->serial_ret == TINF_OK && par->next < par->count;
+    }
+
+    for (u32 i = 0; i < par->workers; i++) {
+        if (par->worker[i].cpu >= 0 && smp_is_busy(par->worker[i].cpu))
+            return true;
+    }
+
+    return false;
+}
+
+// Bytes decompressed so far
+u64 gzip_par_progress(struct gzip_par *par)
+{
+    u64 progress = 0;
+
+    for (u32 i = 0; i < par->workers; i++)
+        progress += par->worker[i].progress;
+
+    return progress;
+}
+
+// Waits for all workers and returns TINF_OK or the first error any of them ran into
+int gzip_par_finish(struct gzip_par *par)
+{
+    int ret = TINF_OK;
+
+    for (u32 i = 0; i < par->workers; i++) {
+        int cpu = par->worker[i].cpu;
+        int wret = cpu >= 0 ? (int)smp_wait(cpu) : par->serial_ret;
+
+        if (ret == TINF_OK)
+            ret = wret;
+    }
+
+    return ret;
+}
+
+int gzip_par_run(struct gzip_par *par)
+{
+    gzip_par_start(par);
+
+    while (gzip_par_poll(par))
+        sched_yield();
+
+    return gzip_par_finish(par);
+}
@@ -0,0 +1,52 @@
+/* SPDX-License-Identifier: MIT */
+
+#ifndef GZIP_H
+#define GZIP_H
+
+#include "smp.h"
+#include "types.h"
+
+/*
+ * Parallel decompression of multi-member gzip streams. The first member's header carries a
+ * member table in an FEXTRA subfield: GZIP_TABLE_SI1, GZIP_TABLE_SI2, then a le32 member count
+ * and a (le32 compressed size, le32 uncompressed size) pair per member, the sizes covering each
+ * whole member including its header and trailer. Members are independent gzip streams, so they
+ * can be decompressed to their precomputed offsets on all idle Firestorm cores at once.
+ */
+#define GZIP_TABLE_SI1 'm'
+#define GZIP_TABLE_SI2 'T'
+
+struct gzip_par;
+
+struct gzip_par_worker {
+    struct gzip_par *par;
+    u32 index;
+    int cpu;
+    volatile u64 progress;
+};
+
+struct gzip_par {
+    const u8 *src;
+    u8 *dest;
+    const u8 *table;
+    u32 count;
+    u32 src_len;
+    u32 dest_len;
+    u32 workers;
+    // With no secondary available: next member, its offsets, and the first error
+    u32 next;
+    u32 src_off;
+    u32 dest_off;
+    int serial_ret;
+    struct gzip_par_worker worker[MAX_CPUS];
+};
+
+int gzip_par_init(struct gzip_par *par, void *dest, size_t dest_len, const void *src,
+                  size_t src_len);
+void gzip_par_start(struct gzip_par *par);
+bool gzip_par_poll(struct gzip_par *par);
+u64 gzip_par_progress(struct gzip_par *par);
+int gzip_par_finish(struct gzip_par *par);
+int gzip_par_run(struct gzip_par *par);
+
+#endif
@@ -1,8 +1,10 @@
 /* SPDX-License-Identifier: MIT */
 
 #include "hv.h"
+#include "aic.h"
 #include "assert.h"
 #include "cpu_regs.h"
+#include "uart.h"
 #include "utils.h"
 
 void hv_enter_guest(u64 x0, u64 x1, u64 x2, u64 x3, void *entry);
@@ -34,8 +36,33 @@ void hv_init(void)
     sysop("isb");
 }
 
+/*
+ * Put the guest vCPU back into its reset state after it has been exited, so that a new kernel
+ * can be started with hv_start() without reinitializing the hypervisor. Stage 2 mappings and
+ * hooks are left alone.
+ */
+void hv_reset_vcpu(void)
+{
+    msr(SCTLR_EL12, mrs(SCTLR_EL12) & ~(SCTLR_M | SCTLR_C | SCTLR_I));
+    msr(VBAR_EL12, 0);
+    msr(TTBR0_EL12, 0);
+    msr(TTBR1_EL12, 0);
+    msr(CNTV_CTL_EL02, 0);
+    msr(CNTP_CTL_EL02, 0);
+    msr(CNTVOFF_EL2, 0);
+
+    sysop("dsb ishst");
+    sysop("tlbi alle1is");
+    sysop("dsb ish");
+    sysop("isb");
+}
+
 void hv_start(void *entry, u64 regs[4])
 {
+    // The guest owns the AIC from here on
+    uart_irq_shutdown();
+    aic_shutdown();
+
     msr(VBAR_EL1, _hv_vectors_start);
 
     hv_enter_guest(regs[0], regs[1], regs[2], regs[3], entry);
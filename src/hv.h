@@ -12,19 +12,38 @@ typedef bool(hv_hook_t)(u64 addr, u64 *val, bool write, int width);
 #define MMIO_EVT_WIDTH GENMASK(2, 0)
 #define MMIO_EVT_WRITE BIT(3)
 
-struct hv_evt_mmiotrace {
-    u32 flags;
-    u32 reserved;
-    u64 pc;
-    u64 addr;
-    u64 data;
-};
+/*
+ * EVT_MMIOTRACE_DELTA payloads are a sequence of records, each a flags byte followed by:
+ *  - MMIO_EVT_KEYFRAME: the absolute PC and address (8 bytes LE each), and with
+ *    MMIO_EVT_TIME the absolute CNTPCT_EL0 timestamp (8 bytes LE). Timestamps are only sent
+ *    while enabled with P_HV_SET_TRACE_TIME.
+ *  - otherwise: a varint PC delta in instructions (omitted with MMIO_EVT_SAME_PC) and a
+ *    varint address delta in bytes, both zigzag-encoded relative to the previous record, and
+ *    with MMIO_EVT_TIME a zigzag varint timestamp delta in timer ticks
+ * and then (1 << width) bytes of data, little-endian. The first record of every event is a
+ * keyframe, so each event decodes on its own.
+ */
+#define MMIO_EVT_KEYFRAME BIT(4)
+#define MMIO_EVT_SAME_PC  BIT(5)
+#define MMIO_EVT_TIME     BIT(6)
 
 struct hv_vm_proxy_hook_data {
     u32 flags;
     u32 id;
     u64 addr;
     u64 data;
+    // CNTPCT_EL0 at the guest exit, only sent inline while trace timestamps are on
+    u64 time;
+};
+
+// HVC immediate used by guests for the paravirtual console
+#define HV_HVC_PVCON 0x4d31
+
+struct hv_time_comp_stats {
+    u64 exits;  // exits accounted for
+    u64 capped; // exits that stalled for longer than the cap
+    u64 total;  // timer ticks hidden from the guest
+    u64 max;    // longest single stall, in timer ticks
 };
 
 typedef enum _hv_hook_type {
@@ -41,17 +60,27 @@ int hv_map_hook(u64 from, hv_hook_t *hook, u64 size);
 int hv_map_proxy_hook(u64 from, u64 id, u64 size);
 u64 hv_translate(u64 addr, bool s1only, bool w);
 u64 hv_pt_walk(u64 addr);
+u64 hv_ipa_to_pa(u64 ipa);
 bool hv_handle_dabort(u64 *regs);
+void hv_trace_flush(void);
+void hv_trace_poll(void);
+void hv_set_trace_time(bool enable);
+bool hv_trace_time(void);
 
 /* Virtual peripherals */
 void hv_map_vuart(u64 base, iodev_id_t iodev);
+void hv_set_pvcon(int iodev);
+void hv_handle_pvcon(u64 *regs);
 
 /* Exceptions */
 void hv_exc_proxy(u64 *regs, uartproxy_boot_reason_t reason, uartproxy_exc_code_t type,
                   void *extra);
+void hv_set_time_comp(bool enable, u64 cap_us);
+struct hv_time_comp_stats *hv_get_time_comp_stats(void);
 
 /* HV main */
 void hv_init(void);
+void hv_reset_vcpu(void);
 void hv_start(void *entry, u64 regs[4]);
 
 #endif
@@ -4,15 +4,72 @@
 #include "assert.h"
 #include "cpu_regs.h"
 #include "exception.h"
+#include "sched.h"
 #include "string.h"
 #include "uartproxy.h"
 
 void hv_exit_guest(void) __attribute__((noreturn));
 
+static bool time_comp_enabled;
+static u64 time_comp_cap;
+static u64 exc_entry_time;
+static bool step_pending;
+static struct hv_time_comp_stats time_comp_stats;
+
+void hv_set_time_comp(bool enable, u64 cap_us)
+{
+    time_comp_enabled = enable;
+    time_comp_cap = cap_us * mrs(CNTFRQ_EL0) / 1000000;
+    memset(&time_comp_stats, 0, sizeof(time_comp_stats));
+}
+
+struct hv_time_comp_stats *hv_get_time_comp_stats(void)
+{
+    return &time_comp_stats;
+}
+
+static void hv_exc_entry(void)
+{
+    exc_entry_time = mrs(CNTPCT_EL0);
+}
+
+/*
+ * Hide the time spent outside the guest by advancing the virtual counter offset, so that
+ * guest-visible time only advances while the guest is actually running.
+ */
+static void hv_exc_exit(void)
+{
+    hv_trace_poll();
+    sched_yield();
+
+    if (time_comp_enabled) {
+        u64 delta = mrs(CNTPCT_EL0) - exc_entry_time;
+
+        time_comp_stats.exits++;
+        time_comp_stats.max = max(time_comp_stats.max, delta);
+        if (time_comp_cap && delta > time_comp_cap) {
+            time_comp_stats.capped++;
+            delta = time_comp_cap;
+        }
+        time_comp_stats.total += delta;
+
+        msr(CNTVOFF_EL2, mrs(CNTVOFF_EL2) + delta);
+    }
+
+    // Arm the single-step timer last, so it is not skewed by the offset change above
+    if (step_pending) {
+        step_pending = false;
+        msr(CNTV_TVAL_EL0, 256);
+        msr(CNTV_CTL_EL0, 1);
+    }
+}
+
 void hv_exc_proxy(u64 *regs, uartproxy_boot_reason_t reason, uartproxy_exc_code_t type, void *extra)
 {
     int from_el = FIELD_GET(SPSR_M, mrs(SPSR_EL2)) >> 2;
 
+    hv_trace_flush();
+
     struct uartproxy_exc_info exc_info = {
         .spsr = mrs(SPSR_EL2),
         .elr = mrs(ELR_EL2),
@@ -24,6 +81,7 @@ void hv_exc_proxy(u64 *regs, uartproxy_boot_reason_t reason, uartproxy_exc_code_
         .far_phys = hv_translate(mrs(FAR_EL2), false, false),
         .sp_phys = hv_translate(from_el == 0 ? mrs(SP_EL0) : mrs(SP_EL1), false, false),
         .extra = extra,
+        .time = exc_entry_time,
     };
     memcpy(exc_info.regs, regs, sizeof(exc_info.regs));
 
@@ -33,7 +91,20 @@ void hv_exc_proxy(u64 *regs, uartproxy_boot_reason_t reason, uartproxy_exc_code_
         .info = &exc_info,
     };
 
-    int ret = uartproxy_run(&start);
+    int ret;
+
+    if (reason == START_HV_HOOK) {
+        struct hv_vm_proxy_hook_data *hook = extra;
+        u16 len = hv_trace_time() ? sizeof(*hook) : offsetof(struct hv_vm_proxy_hook_data, time);
+
+        // Send the hook data along with the exit and take the read value from the host's
+        // P_EXIT, so a proxied MMIO access costs a single exchange.
+        hook->time = exc_entry_time;
+        ret = uartproxy_run_inline(&start, hook, len,
+                                   (hook->flags & MMIO_EVT_WRITE) ? NULL : &hook->data);
+    } else {
+        ret = uartproxy_run(&start);
+    }
 
     switch (ret) {
         case EXC_RET_STEP:
@@ -43,10 +114,8 @@ void hv_exc_proxy(u64 *regs, uartproxy_boot_reason_t reason, uartproxy_exc_code_
             msr(ELR_EL2, exc_info.elr);
             msr(SP_EL0, exc_info.sp[0]);
             msr(SP_EL1, exc_info.sp[1]);
-            if (ret == EXC_RET_STEP) {
-                msr(CNTV_TVAL_EL0, 256);
-                msr(CNTV_CTL_EL0, 1);
-            }
+            if (ret == EXC_RET_STEP)
+                step_pending = true;
             return;
         case EXC_EXIT_GUEST:
             hv_exit_guest();
@@ -59,30 +128,47 @@ void hv_exc_proxy(u64 *regs, uartproxy_boot_reason_t reason, uartproxy_exc_code_
 
 void hv_exc_sync(u64 *regs)
 {
+    bool handled = false;
     u64 esr = mrs(ESR_EL2);
     u32 ec = FIELD_GET(ESR_EC, esr);
 
+    hv_exc_entry();
+
     switch (ec) {
         case ESR_EC_DABORT_LOWER:
-            if (hv_handle_dabort(regs))
-                return;
+            handled = hv_handle_dabort(regs);
+            break;
+        case ESR_EC_HVC:
+            if (FIELD_GET(ESR_ISS, esr) == HV_HVC_PVCON) {
+                hv_handle_pvcon(regs);
+                handled = true;
+            }
             break;
     }
 
-    hv_exc_proxy(regs, START_EXCEPTION_LOWER, EXC_SYNC, NULL);
+    if (!handled)
+        hv_exc_proxy(regs, START_EXCEPTION_LOWER, EXC_SYNC, NULL);
+
+    hv_exc_exit();
 }
 
 void hv_exc_irq(u64 *regs)
 {
+    hv_exc_entry();
     hv_exc_proxy(regs, START_EXCEPTION_LOWER, EXC_IRQ, NULL);
+    hv_exc_exit();
 }
 
 void hv_exc_fiq(u64 *regs)
 {
+    hv_exc_entry();
     hv_exc_proxy(regs, START_EXCEPTION_LOWER, EXC_FIQ, NULL);
+    hv_exc_exit();
 }
 
 void hv_exc_serr(u64 *regs)
 {
+    hv_exc_entry();
     hv_exc_proxy(regs, START_EXCEPTION_LOWER, EXC_SERROR, NULL);
+    hv_exc_exit();
 }
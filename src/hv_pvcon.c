@@ -0,0 +1,63 @@
+/* SPDX-License-Identifier: MIT */
+
+#include "hv.h"
+#include "iodev.h"
+#include "memory.h"
+#include "uartproxy.h"
+#include "utils.h"
+
+// Smallest translation granule the guest might use
+#define PVCON_CHUNK 0x1000
+
+static int pvcon_iodev = -1;
+
+static bool pvcon_output(void *buf, size_t length)
+{
+    if (pvcon_iodev < 0) {
+        // Keep console output ordered with respect to pending MMIO trace records
+        hv_trace_flush();
+        uartproxy_send_event(EVT_PVCON, buf, length);
+    } else if (iodev_can_write(pvcon_iodev)) {
+        iodev_write(pvcon_iodev, buf, length);
+    } else {
+        return false;
+    }
+
+    return true;
+}
+
+/*
+ * hvc #HV_HVC_PVCON: x0 = guest virtual address, x1 = length.
+ * Returns the number of bytes consumed in x0, or -1 if nothing could be output: the buffer does
+ * not translate to guest RAM, or the console device cannot take writes.
+ */
+void hv_handle_pvcon(u64 *regs)
+{
+    u64 va = regs[0];
+    u64 left = regs[1];
+    s64 done = 0;
+
+    while (left) {
+        u64 chunk = min(left, PVCON_CHUNK - (va & (PVCON_CHUNK - 1)));
+        u64 ipa = hv_translate(va, true, false);
+        u64 pa = ipa ? hv_ipa_to_pa(ipa) : 0;
+
+        // Stage 2 can point anywhere, including MMIO; only read RAM that m1n1 has mapped
+        if (!pa || !mmu_is_normal(pa, chunk))
+            break;
+
+        if (!pvcon_output((void *)pa, chunk))
+            break;
+
+        va += chunk;
+        left -= chunk;
+        done += chunk;
+    }
+
+    regs[0] = (done || !regs[1]) ? done : -1;
+}
+
+void hv_set_pvcon(int iodev)
+{
+    pvcon_iodev = (iodev >= 0 && iodev < IODEV_MAX) ? iodev : -1;
+}
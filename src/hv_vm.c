@@ -7,6 +7,7 @@
 #include "cpu_regs.h"
 #include "iodev.h"
 #include "malloc.h"
+#include "memory.h"
 #include "string.h"
 #include "types.h"
 #include "uartproxy.h"
@@ -168,7 +169,7 @@ static u64 *hv_pt_get_l3(u64 from)
         for (u64 idx = 0; idx < ENTRIES_PER_L3_TABLE; idx++, l3d += incr)
             l3[idx] = l3d;
     } else {
-        memset64(l3, 0, ENTRIES_PER_L3_TABLE * sizeof(u64));
+        mem_fill(l3, 0, ENTRIES_PER_L3_TABLE * sizeof(u64), 64);
     }
 
     l2d = ((u64)l3) | FIELD_PREP(PTE_TYPE, PTE_TABLE) | PTE_VALID;
@@ -227,7 +228,7 @@ static u64 *hv_pt_get_l4(u64 from)
         for (u64 idx = 0; idx < ENTRIES_PER_L4_TABLE; idx++, l4d += incr)
             l4[idx] = l4d;
     } else {
-        memset64(l4, 0, ENTRIES_PER_L4_TABLE * sizeof(u64));
+        mem_fill(l4, 0, ENTRIES_PER_L4_TABLE * sizeof(u64), 64);
     }
 
     l3d = ((u64)l4) | FIELD_PREP(PTE_TYPE, PTE_TABLE);
@@ -425,6 +426,24 @@ u64 hv_pt_walk(u64 addr)
     return l4d;
 }
 
+/*
+ * PA that a guest IPA is mapped to in hardware, valid up to the end of its 16K page. Returns 0
+ * if the IPA is unmapped or handled in software (hooks and traced MMIO).
+ */
+u64 hv_ipa_to_pa(u64 ipa)
+{
+    u64 pte;
+
+    if (ipa >= BIT(VADDR_BITS))
+        return 0;
+
+    pte = hv_pt_walk(ipa);
+    if (!IS_HW(pte))
+        return 0;
+
+    return (pte & PTE_TARGET_MASK) | (ipa & MASK(VADDR_L3_OFFSET_BITS));
+}
+
 #define CHECK_RN                                                                                   \
     if (Rn == 31)                                                                                  \
     goto bail
@@ -529,6 +548,119 @@ bail:
     return false;
 }
 
+#define MMIOTRACE_BUF_SIZE 512
+// flags + two 10-byte varints + 64-bit data, and a 10-byte timestamp varint with MMIO_EVT_TIME
+#define MMIOTRACE_REC_MAX  29
+#define MMIOTRACE_TIME_MAX 10
+// Buffered records go out at the next guest exit once the oldest is this old
+#define MMIOTRACE_MAX_AGE_US 10000
+
+static u8 mmiotrace_buf[MMIOTRACE_BUF_SIZE];
+static size_t mmiotrace_len;
+static u64 mmiotrace_pc;
+static u64 mmiotrace_addr;
+static u64 mmiotrace_time;
+static u64 mmiotrace_start;
+static bool mmiotrace_time_en;
+
+static u8 *put_varint(u8 *p, s64 delta)
+{
+    u64 val = (((u64)delta) << 1) ^ (u64)(delta >> 63);
+
+    while (val >= 0x80) {
+        *p++ = val | 0x80;
+        val >>= 7;
+    }
+    *p++ = val;
+
+    return p;
+}
+
+void hv_trace_flush(void)
+{
+    if (!mmiotrace_len)
+        return;
+
+    uartproxy_send_event(EVT_MMIOTRACE_DELTA, mmiotrace_buf, mmiotrace_len);
+    mmiotrace_len = 0;
+}
+
+// Timestamps cost link bandwidth, so they are only sent when the host records a timeline
+void hv_set_trace_time(bool enable)
+{
+    hv_trace_flush();
+    mmiotrace_time_en = enable;
+}
+
+bool hv_trace_time(void)
+{
+    return mmiotrace_time_en;
+}
+
+// Called on every return to the guest, so records are not held back by a quiet guest
+void hv_trace_poll(void)
+{
+    if (mmiotrace_len &&
+        mrs(CNTPCT_EL0) - mmiotrace_start >= MMIOTRACE_MAX_AGE_US * mrs(CNTFRQ_EL0) / 1000000)
+        hv_trace_flush();
+}
+
+/*
+ * Trace records are batched and sent as one event when the buffer fills, when a synchronous
+ * trace is requested, before anything else is sent to the host (see hv_exc_proxy), or on the
+ * first guest exit after MMIOTRACE_MAX_AGE_US (see hv_trace_poll).
+ */
+static void hv_trace_mmio(u64 pc, u64 addr, u64 data, u64 width, bool write, bool sync)
+{
+    size_t rec_max = MMIOTRACE_REC_MAX + (mmiotrace_time_en ? MMIOTRACE_TIME_MAX : 0);
+
+    if (mmiotrace_len + rec_max > sizeof(mmiotrace_buf))
+        hv_trace_flush();
+
+    u8 *p = &mmiotrace_buf[mmiotrace_len];
+    u8 flags = FIELD_PREP(MMIO_EVT_WIDTH, width) | (write ? MMIO_EVT_WRITE : 0);
+    u64 time = mrs(CNTPCT_EL0);
+
+    if (mmiotrace_time_en)
+        flags |= MMIO_EVT_TIME;
+
+    if (!mmiotrace_len) {
+        mmiotrace_start = time;
+        *p++ = flags | MMIO_EVT_KEYFRAME;
+        memcpy(p, &pc, sizeof(pc));
+        p += sizeof(pc);
+        memcpy(p, &addr, sizeof(addr));
+        p += sizeof(addr);
+        if (mmiotrace_time_en) {
+            memcpy(p, &time, sizeof(time));
+            p += sizeof(time);
+        }
+    } else if (pc == mmiotrace_pc) {
+        *p++ = flags | MMIO_EVT_SAME_PC;
+        p = put_varint(p, addr - mmiotrace_addr);
+    } else {
+        *p++ = flags;
+        p = put_varint(p, ((s64)(pc - mmiotrace_pc)) >> 2);
+        p = put_varint(p, addr - mmiotrace_addr);
+    }
+
+    if (mmiotrace_len && mmiotrace_time_en)
+        p = put_varint(p, time - mmiotrace_time);
+
+    memcpy(p, &data, 1 << width);
+    p += 1 << width;
+
+    mmiotrace_len = p - mmiotrace_buf;
+    mmiotrace_pc = pc;
+    mmiotrace_addr = addr;
+    mmiotrace_time = time;
+
+    if (sync) {
+        hv_trace_flush();
+        iodev_flush(uartproxy_iodev);
+    }
+}
+
 bool hv_handle_dabort(u64 *regs)
 {
     u64 esr = mrs(ESR_EL2);
@@ -581,15 +713,7 @@ bool hv_handle_dabort(u64 *regs)
             return false;
 
         if (pte & SPTE_TRACE_WRITE) {
-            struct hv_evt_mmiotrace evt = {
-                .flags = FIELD_PREP(MMIO_EVT_WIDTH, width) | MMIO_EVT_WRITE,
-                .pc = elr,
-                .addr = ipa,
-                .data = val,
-            };
-            uartproxy_send_event(EVT_MMIOTRACE, &evt, sizeof(evt));
-            if (pte & SPTE_SYNC_TRACE)
-                iodev_flush(uartproxy_iodev);
+            hv_trace_mmio(elr, ipa, val, width, true, pte & SPTE_SYNC_TRACE);
         }
 
         switch (FIELD_GET(SPTE_TYPE, pte)) {
@@ -688,15 +812,7 @@ bool hv_handle_dabort(u64 *regs)
         }
 
         if (pte & SPTE_TRACE_READ) {
-            struct hv_evt_mmiotrace evt = {
-                .flags = FIELD_PREP(MMIO_EVT_WIDTH, width),
-                .pc = elr,
-                .addr = ipa,
-                .data = val,
-            };
-            uartproxy_send_event(EVT_MMIOTRACE, &evt, sizeof(evt));
-            if (pte & SPTE_SYNC_TRACE)
-                iodev_flush(uartproxy_iodev);
+            hv_trace_mmio(elr, ipa, val, width, false, pte & SPTE_SYNC_TRACE);
         }
 
         if (!emulate_load(regs, insn, &val, &width))
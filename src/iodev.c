@@ -70,6 +70,27 @@ ssize_t iodev_queue(iodev_id_t id, const void *buf, size_t length)
     return iodevs[id]->ops->queue(iodevs[id]->opaque, buf, length);
 }
 
+ssize_t iodev_writev(iodev_id_t id, const struct iodev_iovec *iov, int iovcnt)
+{
+    ssize_t ret, total = 0;
+
+    if (iodevs[id]->ops->writev)
+        return iodevs[id]->ops->writev(iodevs[id]->opaque, iov, iovcnt);
+
+    // Queue all but the last segment, so the device sees a single write
+    for (int i = 0; i < iovcnt; i++) {
+        if (i == iovcnt - 1)
+            ret = iodev_write(id, iov[i].base, iov[i].len);
+        else
+            ret = iodev_queue(id, iov[i].base, iov[i].len);
+        if (ret < 0)
+            return ret;
+        total += ret;
+    }
+
+    return total;
+}
+
 void iodev_flush(iodev_id_t id)
 {
     if (!iodevs[id]->ops->flush)
@@ -21,12 +21,18 @@ typedef enum _iodev_usage_t {
     USAGE_UARTPROXY = BIT(1),
 } iodev_usage_t;
 
+struct iodev_iovec {
+    const void *base;
+    size_t len;
+};
+
 struct iodev_ops {
     bool (*can_read)(void *opaque);
     bool (*can_write)(void *opaque);
     ssize_t (*read)(void *opaque, void *buf, size_t length);
     ssize_t (*write)(void *opaque, const void *buf, size_t length);
     ssize_t (*queue)(void *opaque, const void *buf, size_t length);
+    ssize_t (*writev)(void *opaque, const struct iodev_iovec *iov, int iovcnt);
     void (*flush)(void *opaque);
     void (*handle_events)(void *opaque);
 };
@@ -45,6 +51,7 @@ bool iodev_can_write(iodev_id_t id);
 ssize_t iodev_read(iodev_id_t id, void *buf, size_t length);
 ssize_t iodev_write(iodev_id_t id, const void *buf, size_t length);
 ssize_t iodev_queue(iodev_id_t id, const void *buf, size_t length);
+ssize_t iodev_writev(iodev_id_t id, const struct iodev_iovec *iov, int iovcnt);
 void iodev_flush(iodev_id_t id);
 void iodev_handle_events(iodev_id_t id);
 
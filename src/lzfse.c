@@ -0,0 +1,642 @@
+/* SPDX-License-Identifier: MIT */
+
+#include "lzfse.h"
+#include "string.h"
+#include "utils.h"
+
+/*
+ * Decoder for Apple's LZFSE and LZVN formats, used for kernelcaches and other Apple payloads. A
+ * stream is a series of blocks, each starting with a "bvx" magic: LZFSE with a plain (v1) or
+ * packed (v2) header, LZVN, uncompressed, or end of stream.
+ *
+ * An LZFSE block holds two FSE (tANS) coded bit streams, both read backwards from their end: the
+ * literals, in four interleaved states, and the (L, M, D) triplets saying how many literals to
+ * copy and which match to copy after them. Like minilzlib, the decoder keeps its tables in
+ * static state, so only one stream can be decoded at a time.
+ */
+
+#define LZFSE_MAGIC_END  0x24787662 // "bvx$"
+#define LZFSE_MAGIC_RAW  0x2d787662 // "bvx-"
+#define LZFSE_MAGIC_V1   0x31787662 // "bvx1"
+#define LZFSE_MAGIC_V2   0x32787662 // "bvx2"
+#define LZFSE_MAGIC_LZVN 0x6e787662 // "bvxn"
+
+#define LZFSE_L_SYMBOLS       20
+#define LZFSE_M_SYMBOLS       20
+#define LZFSE_D_SYMBOLS       64
+#define LZFSE_LITERAL_SYMBOLS 256
+#define LZFSE_SYMBOLS (LZFSE_L_SYMBOLS + LZFSE_M_SYMBOLS + LZFSE_D_SYMBOLS + LZFSE_LITERAL_SYMBOLS)
+
+#define LZFSE_L_STATES       64
+#define LZFSE_M_STATES       64
+#define LZFSE_D_STATES       256
+#define LZFSE_LITERAL_STATES 1024
+
+#define LZFSE_MATCHES_PER_BLOCK  10000
+#define LZFSE_LITERALS_PER_BLOCK (4 * LZFSE_MATCHES_PER_BLOCK)
+
+#define LZFSE_V2_HEADER_LEN 32
+#define LZVN_HEADER_LEN     12
+#define LZFSE_RAW_HEADER_LEN 8
+
+// Block header, as stored in v1 blocks and unpacked from v2 ones
+struct lzfse_header {
+    u32 magic;
+    u32 n_raw_bytes;
+    u32 n_payload_bytes;
+    u32 n_literals;
+    u32 n_matches;
+    u32 n_literal_payload_bytes;
+    u32 n_lmd_payload_bytes;
+    s32 literal_bits;
+    u16 literal_state[4];
+    s32 lmd_bits;
+    u16 l_state;
+    u16 m_state;
+    u16 d_state;
+    u16 l_freq[LZFSE_L_SYMBOLS];
+    u16 m_freq[LZFSE_M_SYMBOLS];
+    u16 d_freq[LZFSE_D_SYMBOLS];
+    u16 literal_freq[LZFSE_LITERAL_SYMBOLS];
+};
+
+struct lzfse_entry {
+    s8 k;
+    u8 symbol;
+    s16 delta;
+};
+
+struct lzfse_value_entry {
+    u8 total_bits; // state bits + value bits
+    u8 value_bits;
+    s16 delta;
+    s32 vbase;
+};
+
+struct lzfse_bits {
+    u64 accum;
+    int nbits;
+};
+
+static const u8 lzfse_l_bits[LZFSE_L_SYMBOLS] = {0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+                                                 0, 0, 0, 0, 0, 0, 2, 3, 5, 8};
+static const u8 lzfse_m_bits[LZFSE_M_SYMBOLS] = {0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+                                                 0, 0, 0, 0, 0, 0, 3, 5, 8, 11};
+
+static struct {
+    struct lzfse_entry literal_table[LZFSE_LITERAL_STATES];
+    struct lzfse_value_entry l_table[LZFSE_L_STATES];
+    struct lzfse_value_entry m_table[LZFSE_M_STATES];
+    struct lzfse_value_entry d_table[LZFSE_D_STATES];
+    u8 d_bits[LZFSE_D_SYMBOLS];
+    s32 l_base[LZFSE_L_SYMBOLS];
+    s32 m_base[LZFSE_M_SYMBOLS];
+    s32 d_base[LZFSE_D_SYMBOLS];
+    u8 literals[LZFSE_LITERALS_PER_BLOCK + 4];
+} lzfse;
+
+static u32 lzfse_le32(const u8 *p)
+{
+    return p[0] | (p[1] << 8) | (p[2] << 16) | ((u32)p[3] << 24);
+}
+
+static u64 lzfse_le64(const u8 *p, int len)
+{
+    u64 v = 0;
+
+    for (int i = len - 1; i >= 0; i--)
+        v = (v << 8) | p[i];
+
+    return v;
+}
+
+bool lzfse_check_magic(const void *src)
+{
+    switch (lzfse_le32(src)) {
+        case LZFSE_MAGIC_RAW:
+        case LZFSE_MAGIC_V1:
+        case LZFSE_MAGIC_V2:
+        case LZFSE_MAGIC_LZVN:
+            return true;
+        default:
+            return false;
+    }
+}
+
+// The value bases follow from the extra bit counts: each symbol covers 1 << bits values
+static void lzfse_init_bases(void)
+{
+    s32 base = 0;
+
+    if (lzfse.d_base[LZFSE_D_SYMBOLS - 1])
+        return;
+
+    for (int i = 0; i < LZFSE_L_SYMBOLS; i++) {
+        lzfse.l_base[i] = base;
+        base += 1 << lzfse_l_bits[i];
+    }
+    base = 0;
+    for (int i = 0; i < LZFSE_M_SYMBOLS; i++) {
+        lzfse.m_base[i] = base;
+        base += 1 << lzfse_m_bits[i];
+    }
+    base = 0;
+    for (int i = 0; i < LZFSE_D_SYMBOLS; i++) {
+        // 0, 0, 0, 0, 1, 1, 1, 1, 2, ... 15
+        lzfse.d_bits[i] = i < 4 ? 0 : (i - 4) / 4 + 1;
+        lzfse.d_base[i] = base;
+        base += 1 << lzfse.d_bits[i];
+    }
+}
+
+/*
+ * Bit streams are read backwards from their end, taking bits from the top of the accumulator.
+ * The first (top) byte may be partial: bits says how many of its bits are unused, as 0 or -1..-7.
+ */
+static int lzfse_bits_init(struct lzfse_bits *s, int bits, const u8 **pbuf, const u8 *start)
+{
+    int len = bits ? 8 : 7;
+
+    if (bits < -7 || bits > 0 || *pbuf - start < len)
+        return -1;
+
+    *pbuf -= len;
+    s->accum = lzfse_le64(*pbuf, len);
+    s->nbits = bits + len * 8;
+
+    return (s->accum >> s->nbits) ? -1 : 0;
+}
+
+// Refill to at least 56 bits, enough for 4 literals or one L, M, D triplet
+static int lzfse_bits_flush(struct lzfse_bits *s, const u8 **pbuf, const u8 *start)
+{
+    int nbits = (63 - s->nbits) & -8;
+    const u8 *buf = *pbuf - (nbits >> 3);
+
+    if (!nbits)
+        return 0;
+    if (buf < start)
+        return -1;
+
+    *pbuf = buf;
+    s->accum = (s->accum << nbits) | lzfse_le64(buf, nbits >> 3);
+    s->nbits += nbits;
+
+    return 0;
+}
+
+static inline u64 lzfse_bits_pull(struct lzfse_bits *s, int n)
+{
+    u64 ret;
+
+    s->nbits -= n;
+    ret = s->accum >> s->nbits;
+    s->accum &= (1UL << s->nbits) - 1;
+
+    return ret;
+}
+
+static inline u8 lzfse_decode_literal(u16 *state, struct lzfse_bits *s)
+{
+    struct lzfse_entry e = lzfse.literal_table[*state];
+
+    *state = e.delta + lzfse_bits_pull(s, e.k);
+    return e.symbol;
+}
+
+static inline u32 lzfse_decode_value(u16 *state, const struct lzfse_value_entry *table,
+                                     struct lzfse_bits *s)
+{
+    struct lzfse_value_entry e = table[*state];
+    u32 bits = lzfse_bits_pull(s, e.total_bits);
+
+    *state = e.delta + (bits >> e.value_bits);
+    return e.vbase + (bits & ((1 << e.value_bits) - 1));
+}
+
+/*
+ * Each symbol with frequency f owns f consecutive states. From a state, the decoder reads k or
+ * k - 1 bits and adds them to delta to get the next state, where k is chosen so that the states
+ * reachable from the symbol's f entries cover all nstates.
+ */
+static int lzfse_check_freq(const u16 *freq, int nsymbols, int nstates)
+{
+    int sum = 0;
+
+    for (int i = 0; i < nsymbols; i++)
+        sum += freq[i];
+
+    return sum > nstates ? -1 : 0;
+}
+
+static void lzfse_init_table(int nstates, int nsymbols, const u16 *freq, struct lzfse_entry *t)
+{
+    int n_clz = __builtin_clz(nstates);
+
+    memset(t, 0, nstates * sizeof(*t));
+
+    for (int i = 0; i < nsymbols; i++) {
+        int f = freq[i];
+        if (!f)
+            continue;
+
+        int k = __builtin_clz(f) - n_clz;
+        int j0 = ((2 * nstates) >> k) - f;
+
+        for (int j = 0; j < f; j++, t++) {
+            t->symbol = i;
+            if (j < j0) {
+                t->k = k;
+                t->delta = ((f + j) << k) - nstates;
+            } else {
+                t->k = k - 1;
+                t->delta = (j - j0) << (k - 1);
+            }
+        }
+    }
+}
+
+static void lzfse_init_value_table(int nstates, int nsymbols, const u16 *freq, const u8 *bits,
+                                   const s32 *base, struct lzfse_value_entry *t)
+{
+    int n_clz = __builtin_clz(nstates);
+
+    memset(t, 0, nstates * sizeof(*t));
+
+    for (int i = 0; i < nsymbols; i++) {
+        int f = freq[i];
+        if (!f)
+            continue;
+
+        int k = __builtin_clz(f) - n_clz;
+        int j0 = ((2 * nstates) >> k) - f;
+
+        for (int j = 0; j < f; j++, t++) {
+            t->value_bits = bits[i];
+            t->vbase = base[i];
+            if (j < j0) {
+                t->total_bits = k + bits[i];
+                t->delta = ((f + j) << k) - nstates;
+            } else {
+                t->total_bits = k - 1 + bits[i];
+                t->delta = (j - j0) << (k - 1);
+            }
+        }
+    }
+}
+
+static u32 lzfse_field(u64 v, int offset, int width)
+{
+    return (v >> offset) & ((1UL << width) - 1);
+}
+
+// Frequencies are coded in 2 to 14 bits, LSB first; the low 5 bits select the code length
+static u16 lzfse_decode_freq(u32 bits, int *nbits)
+{
+    static const u8 freq_nbits[32] = {2, 3, 2, 5, 2, 3, 2, 8, 2, 3, 2, 5, 2, 3, 2, 14,
+                                      2, 3, 2, 5, 2, 3, 2, 8, 2, 3, 2, 5, 2, 3, 2, 14};
+    static const u8 freq_value[32] = {0, 2, 1, 4, 0, 3, 1, 0, 0, 2, 1, 5, 0, 3, 1, 0,
+                                      0, 2, 1, 6, 0, 3, 1, 0, 0, 2, 1, 7, 0, 3, 1, 0};
+    u32 b = bits & 31;
+
+    *nbits = freq_nbits[b];
+    if (*nbits == 8)
+        return 8 + ((bits >> 4) & 0xf);
+    if (*nbits == 14)
+        return 24 + ((bits >> 4) & 0x3ff);
+
+    return freq_value[b];
+}
+
+static int lzfse_unpack_v2(struct lzfse_header *hdr, const u8 *src, size_t avail)
+{
+    u64 v0 = lzfse_le64(src + 8, 8);
+    u64 v1 = lzfse_le64(src + 16, 8);
+    u64 v2 = lzfse_le64(src + 24, 8);
+    u32 header_len = lzfse_field(v2, 0, 32);
+    const u8 *p = src + LZFSE_V2_HEADER_LEN;
+    const u8 *end = src + header_len;
+    u16 *freq = hdr->l_freq;
+    u32 accum = 0;
+    int accum_nbits = 0;
+
+    if (header_len < LZFSE_V2_HEADER_LEN || header_len > avail)
+        return -1;
+
+    hdr->magic = LZFSE_MAGIC_V1;
+    hdr->n_raw_bytes = lzfse_le32(src + 4);
+    hdr->n_literals = lzfse_field(v0, 0, 20);
+    hdr->n_literal_payload_bytes = lzfse_field(v0, 20, 20);
+    hdr->n_matches = lzfse_field(v0, 40, 20);
+    hdr->literal_bits = (int)lzfse_field(v0, 60, 3) - 7;
+    for (int i = 0; i < 4; i++)
+        hdr->literal_state[i] = lzfse_field(v1, 10 * i, 10);
+    hdr->n_lmd_payload_bytes = lzfse_field(v1, 40, 20);
+    hdr->lmd_bits = (int)lzfse_field(v1, 60, 3) - 7;
+    hdr->l_state = lzfse_field(v2, 32, 10);
+    hdr->m_state = lzfse_field(v2, 42, 10);
+    hdr->d_state = lzfse_field(v2, 52, 10);
+    hdr->n_payload_bytes = hdr->n_literal_payload_bytes + hdr->n_lmd_payload_bytes;
+
+    // The frequency tables may be left out entirely
+    memset(freq, 0, LZFSE_SYMBOLS * sizeof(*freq));
+    if (p == end)
+        return header_len;
+
+    for (int i = 0; i < LZFSE_SYMBOLS; i++) {
+        int nbits;
+
+        while (p < end && accum_nbits + 8 <= 32) {
+            accum |= (u32)*p++ << accum_nbits;
+            accum_nbits += 8;
+        }
+
+        freq[i] = lzfse_decode_freq(accum, &nbits);
+        if (nbits > accum_nbits)
+            return -1;
+
+        accum >>= nbits;
+        accum_nbits -= nbits;
+    }
+
+    if (accum_nbits >= 8 || p != end)
+        return -1;
+
+    return header_len;
+}
+
+static int lzfse_check_header(const struct lzfse_header *hdr)
+{
+    for (int i = 0; i < 4; i++) {
+        if (hdr->literal_state[i] >= LZFSE_LITERAL_STATES)
+            return -1;
+    }
+
+    if (hdr->l_state >= LZFSE_L_STATES || hdr->m_state >= LZFSE_M_STATES ||
+        hdr->d_state >= LZFSE_D_STATES)
+        return -1;
+    if (hdr->n_literals > LZFSE_LITERALS_PER_BLOCK || hdr->n_matches > LZFSE_MATCHES_PER_BLOCK)
+        return -1;
+
+    if (lzfse_check_freq(hdr->l_freq, LZFSE_L_SYMBOLS, LZFSE_L_STATES) ||
+        lzfse_check_freq(hdr->m_freq, LZFSE_M_SYMBOLS, LZFSE_M_STATES) ||
+        lzfse_check_freq(hdr->d_freq, LZFSE_D_SYMBOLS, LZFSE_D_STATES) ||
+        lzfse_check_freq(hdr->literal_freq, LZFSE_LITERAL_SYMBOLS, LZFSE_LITERAL_STATES))
+        return -1;
+
+    return 0;
+}
+
+// Matches may overlap their own output, e.g. to repeat a short pattern
+static inline void lzfse_copy_match(u8 *dst, size_t dist, size_t len)
+{
+    const u8 *from = dst - dist;
+
+    if (dist >= len) {
+        memcpy(dst, from, len);
+        return;
+    }
+
+    while (len--)
+        *dst++ = *from++;
+}
+
+static int lzfse_decode_fse(const struct lzfse_header *hdr, const u8 *block, const u8 *payload,
+                            u8 *dst_begin, u8 *dst, u8 *dst_end)
+{
+    const u8 *lmd = payload + hdr->n_literal_payload_bytes;
+    const u8 *buf = lmd;
+    const u8 *lit = lzfse.literals, *lit_end;
+    u8 *block_end;
+    struct lzfse_bits in;
+    u16 states[4];
+    u64 D = 0;
+
+    memcpy(states, hdr->literal_state, sizeof(states));
+    if (hdr->n_raw_bytes > (size_t)(dst_end - dst))
+        return -LZFSE_ERR_NOSPACE;
+    block_end = dst + hdr->n_raw_bytes;
+
+    lzfse_init_table(LZFSE_LITERAL_STATES, LZFSE_LITERAL_SYMBOLS, hdr->literal_freq,
+                     lzfse.literal_table);
+    lzfse_init_value_table(LZFSE_L_STATES, LZFSE_L_SYMBOLS, hdr->l_freq, lzfse_l_bits,
+                           lzfse.l_base, lzfse.l_table);
+    lzfse_init_value_table(LZFSE_M_STATES, LZFSE_M_SYMBOLS, hdr->m_freq, lzfse_m_bits,
+                           lzfse.m_base, lzfse.m_table);
+    lzfse_init_value_table(LZFSE_D_STATES, LZFSE_D_SYMBOLS, hdr->d_freq, lzfse.d_bits,
+                           lzfse.d_base, lzfse.d_table);
+
+    // Reading a stream may run into the bytes before it, which are then never used
+    if (lzfse_bits_init(&in, hdr->literal_bits, &buf, block))
+        return -LZFSE_ERR_DATA;
+
+    for (u32 i = 0; i < hdr->n_literals; i += 4) {
+        if (lzfse_bits_flush(&in, &buf, block))
+            return -LZFSE_ERR_DATA;
+        for (int j = 0; j < 4; j++)
+            lzfse.literals[i + j] = lzfse_decode_literal(&states[j], &in);
+    }
+    lit_end = lzfse.literals + hdr->n_literals;
+
+    u16 l_state = hdr->l_state, m_state = hdr->m_state, d_state = hdr->d_state;
+    buf = lmd + hdr->n_lmd_payload_bytes;
+    if (lzfse_bits_init(&in, hdr->lmd_bits, &buf, block))
+        return -LZFSE_ERR_DATA;
+
+    for (u32 i = 0; i < hdr->n_matches; i++) {
+        if (lzfse_bits_flush(&in, &buf, block))
+            return -LZFSE_ERR_DATA;
+
+        u32 L = lzfse_decode_value(&l_state, lzfse.l_table, &in);
+        u32 M = lzfse_decode_value(&m_state, lzfse.m_table, &in);
+        u32 new_d = lzfse_decode_value(&d_state, lzfse.d_table, &in);
+
+        // A zero distance repeats the previous one
+        if (new_d)
+            D = new_d;
+
+        if (L > (size_t)(lit_end - lit) || L + M > (size_t)(block_end - dst))
+            return -LZFSE_ERR_DATA;
+
+        memcpy(dst, lit, L);
+        dst += L;
+        lit += L;
+
+        if (M) {
+            if (!D || D > (u64)(dst - dst_begin))
+                return -LZFSE_ERR_DATA;
+            lzfse_copy_match(dst, D, M);
+            dst += M;
+        }
+    }
+
+    return dst == block_end ? 0 : -LZFSE_ERR_DATA;
+}
+
+static int lzvn_decode(u8 *dst_begin, u8 *dst, u8 *dst_end, const u8 *src, const u8 *src_end)
+{
+    u64 D = 0;
+
+    while (src < src_end) {
+        u8 op = src[0];
+        u32 len, L = 0, M = 0;
+
+        if (op >= 0xf0) {
+            // Match with the previous distance: 1111MMMM, or 11110000 MMMMMMMM
+            len = op == 0xf0 ? 2 : 1;
+            if ((size_t)(src_end - src) < len)
+                return -LZFSE_ERR_DATA;
+            M = op == 0xf0 ? src[1] + 16 : op & 0xf;
+        } else if (op >= 0xe0) {
+            // Literals: 1110LLLL, or 11100000 LLLLLLLL
+            len = op == 0xe0 ? 2 : 1;
+            if ((size_t)(src_end - src) < len)
+                return -LZFSE_ERR_DATA;
+            L = op == 0xe0 ? src[1] + 16 : op & 0xf;
+        } else if ((op & 0xf0) == 0x70 || (op & 0xf0) == 0xd0) {
+            return -LZFSE_ERR_DATA;
+        } else if ((op & 0xe0) == 0xa0) {
+            // Medium distance: 101LLMMM DDDDDDMM DDDDDDDD
+            len = 3;
+            if ((size_t)(src_end - src) < len)
+                return -LZFSE_ERR_DATA;
+            L = (op >> 3) & 3;
+            M = (((op & 7) << 2) | (src[1] & 3)) + 3;
+            D = (src[1] >> 2) | (src[2] << 6);
+        } else if ((op & 7) == 6) {
+            if (op == 0x06) {
+                // End of stream, followed by 7 zero bytes
+                if (src_end - src < 8)
+                    return -LZFSE_ERR_DATA;
+                return dst == dst_end ? 0 : -LZFSE_ERR_DATA;
+            } else if (op == 0x0e || op == 0x16) {
+                src++;
+                continue;
+            } else if (op < 0x40) {
+                return -LZFSE_ERR_DATA;
+            }
+            // Previous distance: LLMMM110
+            len = 1;
+            L = op >> 6;
+            M = ((op >> 3) & 7) + 3;
+        } else {
+            // Small distance: LLMMMDDD DDDDDDDD, or large distance: LLMMM111 DDDDDDDD DDDDDDDD
+            len = (op & 7) == 7 ? 3 : 2;
+            if ((size_t)(src_end - src) < len)
+                return -LZFSE_ERR_DATA;
+            L = op >> 6;
+            M = ((op >> 3) & 7) + 3;
+            D = len == 3 ? src[1] | (src[2] << 8) : ((op & 7) << 8) | src[1];
+        }
+
+        src += len;
+        if (L > (size_t)(src_end - src) || L + M > (size_t)(dst_end - dst))
+            return -LZFSE_ERR_DATA;
+
+        memcpy(dst, src, L);
+        dst += L;
+        src += L;
+
+        if (M) {
+            if (!D || D > (u64)(dst - dst_begin))
+                return -LZFSE_ERR_DATA;
+            lzfse_copy_match(dst, D, M);
+            dst += M;
+        }
+    }
+
+    return -LZFSE_ERR_DATA;
+}
+
+/*
+ * Decodes a whole stream, up to and including its end of stream block. On entry, *dest_len is
+ * the size of dest, and *src_len the size of src or 0 if unknown. On success, both are set to
+ * the number of bytes produced and consumed.
+ */
+int lzfse_decode(void *dest, size_t *dest_len, const void *src, size_t *src_len)
+{
+    const u8 *p = src;
+    const u8 *src_end = *src_len ? p + *src_len : (const u8 *)~0UL;
+    u8 *dst_begin = dest, *dst = dest, *dst_end = dst + *dest_len;
+
+    lzfse_init_bases();
+
+    while (1) {
+        size_t avail = src_end - p;
+        struct lzfse_header hdr;
+        u32 magic, n_raw, n_payload;
+        int ret;
+
+        if (avail < 4)
+            return -LZFSE_ERR_DATA;
+
+        magic = lzfse_le32(p);
+        switch (magic) {
+            case LZFSE_MAGIC_END:
+                *src_len = p + 4 - (const u8 *)src;
+                *dest_len = dst - dst_begin;
+                return 0;
+
+            case LZFSE_MAGIC_RAW:
+                if (avail < LZFSE_RAW_HEADER_LEN)
+                    return -LZFSE_ERR_DATA;
+                n_raw = lzfse_le32(p + 4);
+                if (n_raw > avail - LZFSE_RAW_HEADER_LEN)
+                    return -LZFSE_ERR_DATA;
+                if (n_raw > (size_t)(dst_end - dst))
+                    return -LZFSE_ERR_NOSPACE;
+                memcpy(dst, p + LZFSE_RAW_HEADER_LEN, n_raw);
+                dst += n_raw;
+                p += LZFSE_RAW_HEADER_LEN + n_raw;
+                break;
+
+            case LZFSE_MAGIC_LZVN:
+                if (avail < LZVN_HEADER_LEN)
+                    return -LZFSE_ERR_DATA;
+                n_raw = lzfse_le32(p + 4);
+                n_payload = lzfse_le32(p + 8);
+                if (n_payload > avail - LZVN_HEADER_LEN)
+                    return -LZFSE_ERR_DATA;
+                if (n_raw > (size_t)(dst_end - dst))
+                    return -LZFSE_ERR_NOSPACE;
+                ret = lzvn_decode(dst_begin, dst, dst + n_raw, p + LZVN_HEADER_LEN,
+                                  p + LZVN_HEADER_LEN + n_payload);
+                if (ret)
+                    return ret;
+                dst += n_raw;
+                p += LZVN_HEADER_LEN + n_payload;
+                break;
+
+            case LZFSE_MAGIC_V1:
+            case LZFSE_MAGIC_V2:
+                if (magic == LZFSE_MAGIC_V1) {
+                    if (avail < sizeof(hdr))
+                        return -LZFSE_ERR_DATA;
+                    memcpy(&hdr, p, sizeof(hdr));
+                    ret = sizeof(hdr);
+                } else {
+                    if (avail < LZFSE_V2_HEADER_LEN)
+                        return -LZFSE_ERR_DATA;
+                    ret = lzfse_unpack_v2(&hdr, p, avail);
+                    if (ret < 0)
+                        return -LZFSE_ERR_DATA;
+                }
+
+                if (lzfse_check_header(&hdr) ||
+                    (u64)hdr.n_literal_payload_bytes + hdr.n_lmd_payload_bytes > avail - ret)
+                    return -LZFSE_ERR_DATA;
+
+                n_payload = hdr.n_literal_payload_bytes + hdr.n_lmd_payload_bytes;
+                p += ret;
+                ret = lzfse_decode_fse(&hdr, p - ret, p, dst_begin, dst, dst_end);
+                if (ret)
+                    return ret;
+                dst += hdr.n_raw_bytes;
+                p += n_payload;
+                break;
+
+            default:
+                return -LZFSE_ERR_DATA;
+        }
+    }
+}
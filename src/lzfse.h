@@ -0,0 +1,14 @@
+/* SPDX-License-Identifier: MIT */
+
+#ifndef LZFSE_H
+#define LZFSE_H
+
+#include "types.h"
+
+#define LZFSE_ERR_DATA    1 // corrupt or unsupported stream
+#define LZFSE_ERR_NOSPACE 2 // the output does not fit in the destination
+
+bool lzfse_check_magic(const void *src);
+int lzfse_decode(void *dest, size_t *dest_len, const void *src, size_t *src_len);
+
+#endif
@@ -0,0 +1,230 @@
+/* SPDX-License-Identifier: MIT */
+
+#include "macho.h"
+#include "memory.h"
+#include "string.h"
+#include "utils.h"
+
+/*
+ * Lays out a Mach-O file the same way as MachO.prepare_image() in the proxyclient: every
+ * LC_SEGMENT_64 is copied to its vmaddr relative to the lowest one, and zero-filled up to its
+ * vmsize. The host then only has to upload the file itself, without the padding and bss.
+ */
+
+#define MH_MAGIC_64 0xfeedfacf
+
+#define LC_UNIXTHREAD     0x05
+#define LC_SEGMENT_64     0x19
+#define LC_FILESET_ENTRY  0x80000035
+
+#define ARM_THREAD_STATE64 6
+#define THREAD_STATE_PC    32 // x0-x28, fp, lr, sp, then pc
+
+struct mach_header_64 {
+    u32 magic;
+    u32 cputype;
+    u32 cpusubtype;
+    u32 filetype;
+    u32 ncmds;
+    u32 sizeofcmds;
+    u32 flags;
+    u32 reserved;
+};
+
+struct load_command {
+    u32 cmd;
+    u32 cmdsize;
+};
+
+struct segment_command_64 {
+    u32 cmd;
+    u32 cmdsize;
+    char segname[16];
+    u64 vmaddr;
+    u64 vmsize;
+    u64 fileoff;
+    u64 filesize;
+    u32 maxprot;
+    u32 initprot;
+    u32 nsects;
+    u32 flags;
+};
+
+struct fileset_entry_command {
+    u32 cmd;
+    u32 cmdsize;
+    u64 vmaddr;
+    u64 fileoff;
+    u32 entry_id;
+    u32 reserved;
+};
+
+struct thread_command {
+    u32 cmd;
+    u32 cmdsize;
+    u32 flavor;
+    u32 count;
+    u64 state[];
+};
+
+#define MACHO_FOREACH_CMD(hdr, lc)                                                                 \
+    for (const struct load_command *lc = (const void *)((hdr) + 1);                                \
+         (const u8 *)lc < (const u8 *)((hdr) + 1) + (hdr)->sizeofcmds;                             \
+         lc = (const void *)((const u8 *)lc + lc->cmdsize))
+
+// Checks that the header and all load commands lie within the file
+static const struct mach_header_64 *macho_header(const u8 *src, size_t src_len, u64 off)
+{
+    const struct mach_header_64 *hdr = (const void *)(src + off);
+    u64 end;
+
+    if (off > src_len || src_len - off < sizeof(*hdr) || (off & 7) || hdr->magic != MH_MAGIC_64)
+        return NULL;
+
+    end = off + sizeof(*hdr) + hdr->sizeofcmds;
+    if (end > src_len)
+        return NULL;
+
+    u32 left = hdr->sizeofcmds, count = 0;
+    MACHO_FOREACH_CMD(hdr, lc)
+    {
+        if (left < sizeof(*lc) || lc->cmdsize < sizeof(*lc) || lc->cmdsize > left ||
+            (lc->cmdsize & 7))
+            return NULL;
+        left -= lc->cmdsize;
+        count++;
+    }
+
+    return count == hdr->ncmds ? hdr : NULL;
+}
+
+static bool macho_entry(const struct mach_header_64 *hdr, u64 *entry)
+{
+    MACHO_FOREACH_CMD(hdr, lc)
+    {
+        const struct thread_command *tc = (const void *)lc;
+
+        if (lc->cmd != LC_UNIXTHREAD || tc->flavor != ARM_THREAD_STATE64 ||
+            lc->cmdsize < sizeof(*tc) + (THREAD_STATE_PC + 1) * sizeof(u64))
+            continue;
+
+        *entry = tc->state[THREAD_STATE_PC];
+        return true;
+    }
+
+    return false;
+}
+
+static bool macho_is_payload(const struct segment_command_64 *seg)
+{
+    return !strncmp(seg->segname, "PYLD", sizeof(seg->segname));
+}
+
+// The part of a segment that comes from the file, which may be truncated
+static u64 macho_seg_filesize(const struct segment_command_64 *seg, size_t src_len)
+{
+    return min(min(seg->filesize, src_len - seg->fileoff), seg->vmsize);
+}
+
+int macho_load(const void *src, size_t src_len, void *dest, size_t dest_size,
+               struct macho_info *info)
+{
+    const struct mach_header_64 *hdr = macho_header(src, src_len, 0);
+    u64 vmin = ~0UL, vmax = 0, entry = 0, image_size;
+    bool have_entry;
+    u8 *out = dest;
+
+    memset(info, 0, sizeof(*info));
+
+    if (!hdr)
+        return -MACHO_ERR_FORMAT;
+
+    MACHO_FOREACH_CMD(hdr, lc)
+    {
+        const struct segment_command_64 *seg = (const void *)lc;
+
+        if (lc->cmd == LC_FILESET_ENTRY) {
+            // The top-level segments cover the entries; they only matter for the entry point
+            if (lc->cmdsize < sizeof(struct fileset_entry_command))
+                return -MACHO_ERR_FORMAT;
+            info->filesets++;
+            continue;
+        }
+
+        if (lc->cmd != LC_SEGMENT_64)
+            continue;
+        if (lc->cmdsize < sizeof(*seg) || seg->vmaddr + seg->vmsize < seg->vmaddr ||
+            seg->fileoff > src_len)
+            return -MACHO_ERR_FORMAT;
+
+        vmin = min(vmin, seg->vmaddr);
+        vmax = max(vmax, seg->vmaddr + seg->vmsize);
+        info->segments++;
+    }
+
+    if (!info->segments)
+        return -MACHO_ERR_FORMAT;
+
+    have_entry = macho_entry(hdr, &entry);
+    if (!have_entry) {
+        // Kernelcache filesets may only have a LC_UNIXTHREAD in the kernel's own header
+        MACHO_FOREACH_CMD(hdr, lc)
+        {
+            const struct fileset_entry_command *fe = (const void *)lc;
+            const struct mach_header_64 *sub;
+
+            if (lc->cmd != LC_FILESET_ENTRY)
+                continue;
+            sub = macho_header(src, src_len, fe->fileoff);
+            if (sub && macho_entry(sub, &entry)) {
+                have_entry = true;
+                break;
+            }
+        }
+    }
+
+    // The image ends 4 bytes into the PYLD bss, which holds the payloads (see payload.c)
+    image_size = vmax - vmin;
+    MACHO_FOREACH_CMD(hdr, lc)
+    {
+        const struct segment_command_64 *seg = (const void *)lc;
+
+        if (lc->cmd != LC_SEGMENT_64 || !macho_is_payload(seg))
+            continue;
+
+        u64 size = macho_seg_filesize(seg, src_len);
+        if (seg->vmsize > size)
+            image_size = min(image_size, seg->vmaddr - vmin + size + 4);
+    }
+
+    if (image_size > dest_size)
+        return -MACHO_ERR_NOSPACE;
+    if (out < (const u8 *)src + src_len && (const u8 *)src < out + image_size)
+        return -MACHO_ERR_OVERLAP;
+
+    MACHO_FOREACH_CMD(hdr, lc)
+    {
+        const struct segment_command_64 *seg = (const void *)lc;
+
+        if (lc->cmd != LC_SEGMENT_64 || seg->vmaddr - vmin >= image_size)
+            continue;
+
+        u64 off = seg->vmaddr - vmin;
+        u64 size = min(macho_seg_filesize(seg, src_len), image_size - off);
+        u64 end = min(seg->vmsize, image_size - off);
+
+        memcpy(out + off, (const u8 *)src + seg->fileoff, size);
+        if (end > size)
+            memset(out + off + size, 0, end - size);
+    }
+
+    dc_cvau_range(out, image_size);
+    ic_ivau_range(out, image_size);
+
+    info->entry = have_entry ? entry - vmin + (u64)out : 0;
+    info->vmin = vmin;
+    info->vmax = vmax;
+    info->image_size = image_size;
+
+    return 0;
+}
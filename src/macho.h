@@ -0,0 +1,25 @@
+/* SPDX-License-Identifier: MIT */
+
+#ifndef MACHO_H
+#define MACHO_H
+
+#include "types.h"
+
+#define MACHO_ERR_FORMAT  1 // not a 64-bit Mach-O, or a load command is out of bounds
+#define MACHO_ERR_NOSPACE 2 // the laid out image does not fit in the destination
+#define MACHO_ERR_OVERLAP 3 // the destination overlaps the source file
+
+// Filled in by macho_load(); addresses are the slid ones, i.e. in the destination buffer
+struct macho_info {
+    u64 entry;
+    u64 vmin;       // lowest segment vmaddr, as linked
+    u64 vmax;       // end of the highest segment, as linked
+    u64 image_size; // bytes laid out from the destination, as prepare_image() would return
+    u32 segments;
+    u32 filesets;
+};
+
+int macho_load(const void *src, size_t src_len, void *dest, size_t dest_size,
+               struct macho_info *info);
+
+#endif
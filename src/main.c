@@ -3,6 +3,7 @@
 #include "../config.h"
 
 #include "adt.h"
+#include "aic.h"
 #include "exception.h"
 #include "fb.h"
 #include "heapblock.h"
@@ -10,6 +11,9 @@
 #include "payload.h"
 #include "pcie.h"
 #include "pmgr.h"
+#include "proxy_job.h"
+#include "sched.h"
+#include "simd.h"
 #include "smp.h"
 #include "string.h"
 #include "uart.h"
@@ -74,6 +78,9 @@ void m1n1_main(void)
 
     heapblock_init();
     mmu_init();
+    simd_init();
+    sched_init();
+    job_init();
 
 #ifdef USE_FB
     fb_init();
@@ -83,6 +90,8 @@ void m1n1_main(void)
     print_info();
     wdt_disable();
     pmgr_init();
+    aic_init();
+    uart_irq_init();
     pcie_init();
 
     printf("Initialization complete.\n");
@@ -95,6 +104,8 @@ void m1n1_main(void)
 
     printf("Preparing to run next stage at %p...\n", next_stage.entry);
 
+    uart_irq_shutdown();
+    aic_shutdown();
     exception_shutdown();
     usb_shutdown();
     mmu_shutdown();
@@ -311,6 +311,9 @@ static u64 mmu_make_table_pte(u64 *addr)
     return pte;
 }
 
+// SPRR permission indices in use by m1n1's own mappings, see mmu_sprr_used_indices()
+static u16 mmu_sprr_indices;
+
 static void mmu_init_pagetables(void)
 {
     memset64(mmu_pt_L0, 0, sizeof mmu_pt_L0);
@@ -318,10 +321,14 @@ static void mmu_init_pagetables(void)
 
     mmu_pt_L0[0] = mmu_make_table_pte(&mmu_pt_L1[0]);
     mmu_pt_L0[1] = mmu_make_table_pte(&mmu_pt_L1[ENTRIES_PER_L1_TABLE >> 1]);
+    mmu_sprr_indices = 0;
 }
 
 static void mmu_add_mapping(u64 from, u64 to, size_t size, u8 attribute_index, u64 perms)
 {
+    if (from < REGION_SPRR_TEST || from >= SPRR_TEST_PAGE(16))
+        mmu_sprr_indices |= BIT(SPRR_INDEX(perms));
+
     if (mmu_map(from, to | PTE_MAIR_IDX(attribute_index) | PTE_ACCESS | PTE_VALID | perms, size) <
         0)
         panic("Failed to add MMU mapping 0x%lx -> 0x%lx (0x%lx)\n", from, to, size);
@@ -411,6 +418,16 @@ static void mmu_init_sprr(void)
     msr_sync(SYS_IMP_APL_SPRR_CONFIG_EL1, 0);
 }
 
+static u64 mmu_sctlr(void)
+{
+    // RES1 bits
+    u64 sctlr = SCTLR_LSMAOE | SCTLR_nTLSMD | SCTLR_TSCXT | SCTLR_ITD;
+    // Configure translation
+    sctlr |= SCTLR_I | SCTLR_C | SCTLR_M | SCTLR_SPAN;
+
+    return sctlr;
+}
+
 void mmu_init(void)
 {
     printf("MMU: Initializing...\n");
@@ -428,16 +445,28 @@ void mmu_init(void)
     // Enable EL0 memory access by EL1
     msr(PAN, 0);
 
-    // RES1 bits
-    u64 sctlr = SCTLR_LSMAOE | SCTLR_nTLSMD | SCTLR_TSCXT | SCTLR_ITD;
-    // Configure translation
-    sctlr |= SCTLR_I | SCTLR_C | SCTLR_M | SCTLR_SPAN;
-
+    u64 sctlr = mmu_sctlr();
     printf("MMU: SCTLR_EL1: %lx -> %lx\n", mrs(SCTLR_EL1), sctlr);
     write_sctlr(sctlr);
     printf("MMU: running with MMU and caches enabled!\n");
 }
 
+/*
+ * Enable the MMU on a secondary CPU, reusing the page tables built by the boot CPU.
+ * Must only be called after mmu_init() has run on the boot CPU.
+ */
+void mmu_init_secondary(void)
+{
+    if (!mmu_pt_L0[0] || (read_sctlr() & SCTLR_M))
+        return;
+
+    mmu_configure();
+    mmu_init_sprr();
+
+    msr(PAN, 0);
+    write_sctlr(mmu_sctlr());
+}
+
 void mmu_shutdown(void)
 {
     fb_console_reserve_lines(3);
@@ -463,3 +492,114 @@ void mmu_restore(u64 state)
 {
     write_sctlr(state);
 }
+
+/*
+ * Map one page 16 times from REGION_SPRR_TEST, with SPRR_TEST_PAGE(n) using the PTE permission
+ * bits that select SPRR permission index n (see SPRR_INDEX).
+ */
+int mmu_map_sprr_test(u64 phys)
+{
+    if (!mmu_pt_L0[0] || (phys & (PAGE_SIZE - 1)))
+        return -1;
+
+    for (int i = 0; i < 16; i++) {
+        u64 perms = ((i & 0b1000) ? PTE_AP_RO : 0) | ((i & 0b0100) ? PTE_AP_EL0 : 0) |
+                    ((i & 0b0010) ? PTE_UXN : 0) | ((i & 0b0001) ? PTE_PXN : 0);
+
+        mmu_add_mapping(SPRR_TEST_PAGE(i), phys, PAGE_SIZE, MAIR_IDX_NORMAL, perms);
+    }
+
+    sysop("dsb ishst");
+    sysop("tlbi vmalle1is");
+    sysop("dsb ish");
+    sysop("isb");
+
+    return 0;
+}
+
+/*
+ * SPRR permission indices of every mapping m1n1 has made outside REGION_SPRR_TEST: its own code,
+ * data and stacks, the RAM aliases and MMIO, including the UART.
+ */
+u16 mmu_sprr_used_indices(void)
+{
+    return mmu_sprr_indices;
+}
+
+#define RAM_BASE 0x0800000000
+#define RAM_SIZE 0x0400000000
+
+// Below this, the width-exact loops are just as fast
+#define MEM_FAST_MIN_SIZE 256
+
+/*
+ * True if [addr, addr + size) is entirely in one of the cacheable RAM mappings set up by
+ * mmu_init() and the MMU and data cache are on, i.e. DC ZVA, prefetches and paired accesses
+ * are safe there.
+ */
+bool mmu_is_normal(u64 addr, size_t size)
+{
+    u64 sctlr = read_sctlr();
+    u64 region = addr & ~(RAM_BASE | (RAM_SIZE - 1));
+
+    if (!(sctlr & SCTLR_M) || !(sctlr & SCTLR_C))
+        return false;
+
+    if (region != 0 && region != REGION_RWX_EL0 && region != REGION_RW_EL0)
+        return false;
+
+    addr &= RAM_BASE | (RAM_SIZE - 1);
+    return addr >= RAM_BASE && size <= RAM_BASE + RAM_SIZE - addr;
+}
+
+static bool mem_fast_ok(u64 addr, size_t size, int width)
+{
+    return width == 64 && size >= MEM_FAST_MIN_SIZE && !(addr & 7) && mmu_is_normal(addr, size);
+}
+
+void *mem_copy_func(void *dst, void *src, size_t size, int width)
+{
+    switch (width) {
+        case 64:
+            if (!((u64)src & 7) && mem_fast_ok((u64)dst, size, width) &&
+                mmu_is_normal((u64)src, size))
+                return memcpy_normal;
+            return memcpy64;
+        case 32:
+            return memcpy32;
+        case 16:
+            return memcpy16;
+        default:
+            return memcpy8;
+    }
+}
+
+void *mem_fill_func(void *dst, u64 value, size_t size, int width)
+{
+    switch (width) {
+        case 64:
+            if (!value && mem_fast_ok((u64)dst, size, width))
+                return memset64_normal;
+            return memset64;
+        case 32:
+            return memset32;
+        case 16:
+            return memset16;
+        default:
+            return memset8;
+    }
+}
+
+void mem_copy(void *dst, void *src, size_t size, int width)
+{
+    void (*func)(void *, void *, size_t) = mem_copy_func(dst, src, size, width);
+
+    func(dst, src, size);
+}
+
+void mem_fill(void *dst, u64 value, size_t size, int width)
+{
+    void (*func)(void *, u64, size_t) = mem_fill_func(dst, value, size, width);
+
+    func(dst, value, size);
+}
@@ -9,6 +9,9 @@
 #define REGION_RW_EL0  0x9000000000
 #define REGION_RX_EL1  0xa000000000
 
+#define REGION_SPRR_TEST   0xb000000000
+#define SPRR_TEST_PAGE(n) (REGION_SPRR_TEST + (n) * 0x4000)
+
 #ifndef __ASSEMBLER__
 
 void ic_ivau_range(void *addr, size_t length);
@@ -24,11 +27,27 @@ void dc_civac_range(void *addr, size_t length);
 void dcsw_op_all(u64 op_type);
 
 void mmu_init(void);
+void mmu_init_secondary(void);
 void mmu_shutdown(void);
 
+bool mmu_is_normal(u64 addr, size_t size);
+
+/*
+ * Width-exact copy/fill like memcpy64() and friends, switching to the unrolled, prefetching or
+ * DC ZVA paths when the range is large, aligned and in cacheable RAM. The *_func variants just
+ * return the chosen leaf routine, for callers that need to run it under an exception guard.
+ */
+void *mem_copy_func(void *dst, void *src, size_t size, int width);
+void *mem_fill_func(void *dst, u64 value, size_t size, int width);
+void mem_copy(void *dst, void *src, size_t size, int width);
+void mem_fill(void *dst, u64 value, size_t size, int width);
+
 u64 mmu_disable(void);
 void mmu_restore(u64 state);
 
+int mmu_map_sprr_test(u64 phys);
+u16 mmu_sprr_used_indices(void);
+
 #endif
 
 #endif
@@ -29,19 +29,8 @@ Environment:
 #include "minlzlib.h"
 
 //
-// State used for the history buffer (dictionary)
+// State used for the history buffer (dictionary), see minlzlib.h
 //
-typedef struct _DICTIONARY_STATE
-{
-    //
-    // Buffer, start position, current position, and offset limit in the buffer
-    //
-    uint8_t* Buffer;
-    uint32_t BufferSize;
-    uint32_t Start;
-    uint32_t Offset;
-    uint32_t Limit;
-} DICTIONARY_STATE, *PDICTIONARY_STATE;
 DICTIONARY_STATE Dictionary;
 
 void
@@ -100,39 +89,16 @@ DtCanWrite (
     return (Dictionary.Offset < Dictionary.Limit);
 }
 
-uint8_t
-DtGetSymbol (
-    uint32_t Distance
-    )
-{
-    //
-    // If the dictionary is still empty, just return 0, otherwise, return the
-    // symbol that is Distance bytes backward.
-    //
-    if (Distance > Dictionary.Offset)
-    {
-        return 0;
-    }
-    return Dictionary.Buffer[Dictionary.Offset - Distance];
-}
-
-void
-DtPutSymbol (
-    uint8_t Symbol
-    )
-{
-    //
-    // Write the symbol and advance our position
-    //
-    Dictionary.Buffer[Dictionary.Offset++] = Symbol;
-}
-
 bool
 DtRepeatSymbol (
     uint32_t Length,
     uint32_t Distance
     )
 {
+    uint8_t* dst;
+    const uint8_t* src;
+    uint8_t symbol;
+
     //
     // Make sure we never get asked to write past the end of the dictionary. We
     // should also not allow the distance to go beyond the current offset since
@@ -145,11 +111,75 @@ DtRepeatSymbol (
     }
 
     //
-    // Now rewrite the stream of past symbols forward into the dictionary.
+    // Now rewrite the stream of past symbols forward into the dictionary. When
+    // the distance is at least as large as a machine word, each word we read
+    // was completely written before, so the copy can go a word at a time. The
+    // source and destination then need the same alignment, since unaligned
+    // accesses are not always allowed, which is the case when the distance is
+    // a multiple of the word size (as with most matches in structured data).
+    // A distance of 1 just repeats the last symbol, and anything else is done
+    // byte by byte, with the loop unrolled for the longer lengths.
     //
-    do
+    dst = &Dictionary.Buffer[Dictionary.Offset];
+    src = dst - Distance;
+    Dictionary.Offset += Length;
+
+    if (Distance == 1)
+    {
+        symbol = *src;
+        do
+        {
+            *dst++ = symbol;
+        } while (--Length > 0);
+        return true;
+    }
+
+    if ((Length >= 16) && (Distance >= sizeof(uint64_t)) &&
+        ((Distance & (sizeof(uint64_t) - 1)) == 0))
     {
-        DtPutSymbol(DtGetSymbol(Distance));
-    } while (--Length > 0);
+        while ((uintptr_t)dst & (sizeof(uint64_t) - 1))
+        {
+            *dst++ = *src++;
+            Length--;
+        }
+        for (; Length >= sizeof(uint64_t); Length -= sizeof(uint64_t))
+        {
+            *(uint64_t*)dst = *(const uint64_t*)src;
+            dst += sizeof(uint64_t);
+            src += sizeof(uint64_t);
+        }
+    }
+    else if ((Length >= 16) && (Distance >= sizeof(uint32_t)) &&
+             ((Distance & (sizeof(uint32_t) - 1)) == 0))
+    {
+        while ((uintptr_t)dst & (sizeof(uint32_t) - 1))
+        {
+            *dst++ = *src++;
+            Length--;
+        }
+        for (; Length >= sizeof(uint32_t); Length -= sizeof(uint32_t))
+        {
+            *(uint32_t*)dst = *(const uint32_t*)src;
+            dst += sizeof(uint32_t);
+            src += sizeof(uint32_t);
+        }
+    }
+    else
+    {
+        for (; Length >= 4; Length -= 4)
+        {
+            dst[0] = src[0];
+            dst[1] = src[1];
+            dst[2] = src[2];
+            dst[3] = src[3];
+            dst += 4;
+            src += 4;
+        }
+    }
+
+    while (Length-- > 0)
+    {
+        *dst++ = *src++;
+    }
     return true;
 }
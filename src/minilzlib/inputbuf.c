@@ -102,6 +102,18 @@ BfSeek (
     return true;
 }
 
+uint8_t*
+BfGetSoftLimit (
+    void
+    )
+{
+    //
+    // Return the end of the current packet, for readers that go through the
+    // buffer directly instead of byte by byte (see RcNormalize)
+    //
+    return &In.Buffer[In.SoftLimit];
+}
+
 uint32_t
 BfTell (
     void
@@ -26,6 +26,7 @@ Environment:
 
 #include "minlzlib.h"
 #include "lzma2dec.h"
+#include "../sched.h"
 
 bool
 Lz2DecodeChunk (
@@ -84,6 +85,11 @@ Lz2DecodeStream (
     *BytesProcessed = 0;
     while (BfRead(&controlByte.Value))
     {
+        //
+        // Let m1n1 background tasks run between chunks
+        //
+        sched_yield();
+
         //
         // When the LZMA2 control byte is 0, the entire stream is decoded. This
         // is the only success path out of this function.
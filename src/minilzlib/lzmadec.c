@@ -248,7 +248,8 @@ LzDecodeLiteral (
     )
 {
     uint16_t* probArray;
-    uint8_t symbol, matchByte;
+    uint16_t symbol;
+    uint8_t matchByte, matchBit, bit;
 
     //
     // First, choose the correct arithmetic-coded bit tree (which is based on
@@ -260,24 +261,38 @@ LzDecodeLiteral (
     // rep0.
     //
     // Based on this match byte, we'll then use 2 other potential bit trees,
-    // see LzDecodeMatched for more information.
+    // see RcDecodeMatchedBitTree for more information.
+    //
+    // Both bit tree walks are done right here rather than through RcGetBitTree
+    // and RcDecodeMatchedBitTree, since literals are the most common packets
+    // and the per-bit work (RcIsBitSet) is inlined.
     //
     probArray = LzGetLiteralSlot();
-    if (LzIsLiteral(Decoder.Sequence))
+    symbol = 1;
+    if (!LzIsLiteral(Decoder.Sequence))
     {
-
-        symbol = RcGetBitTree(probArray, (1 << 8));
+        matchByte = DtGetSymbol(Decoder.Rep0 + 1);
+        do
+        {
+            matchBit = (matchByte >> 7) & 1;
+            matchByte <<= 1;
+            bit = RcIsBitSet(&probArray[symbol + (0x100 * (matchBit + 1))]);
+            symbol = (symbol << 1) | bit;
+            if (matchBit != bit)
+            {
+                break;
+            }
+        } while (symbol < 0x100);
     }
-    else
+    while (symbol < 0x100)
     {
-        matchByte = DtGetSymbol(Decoder.Rep0 + 1);
-        symbol = RcDecodeMatchedBitTree(probArray, matchByte);
+        symbol = (symbol << 1) | RcIsBitSet(&probArray[symbol]);
     }
 
     //
     // Write the symbol and indicate that the last sequence was a literal
     //
-    DtPutSymbol(symbol);
+    DtPutSymbol((uint8_t)symbol);
     LzSetLiteral(&Decoder.Sequence);
 }
 
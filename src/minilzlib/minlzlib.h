@@ -42,6 +42,7 @@ bool BfAlign(void);
 void BfInitialize(uint8_t* InputBuffer, uint32_t InputSize);
 bool BfSetSoftLimit(uint32_t Remaining);
 void BfResetSoftLimit(void);
+uint8_t* BfGetSoftLimit(void);
 
 //
 // Dictionary (History Buffer) Management
@@ -49,8 +50,6 @@ void BfResetSoftLimit(void);
 bool DtRepeatSymbol(uint32_t Length, uint32_t Distance);
 void DtInitialize(uint8_t* HistoryBuffer, uint32_t Position);
 bool DtSetLimit(uint32_t Limit);
-void DtPutSymbol(uint8_t Symbol);
-uint8_t DtGetSymbol(uint32_t Distance);
 bool DtCanWrite(uint32_t* Position);
 bool DtIsComplete(uint32_t* BytesProcessed);
 
@@ -62,8 +61,6 @@ uint8_t RcGetReverseBitTree(uint16_t* BitModel, uint8_t HighestBit);
 uint8_t RcDecodeMatchedBitTree(uint16_t* BitModel, uint8_t MatchByte);
 uint32_t RcGetFixed(uint8_t HighestBit);
 bool RcInitialize(uint16_t* ChunkSize);
-uint8_t RcIsBitSet(uint16_t* Probability);
-void RcNormalize(void);
 bool RcCanRead(void);
 bool RcIsComplete(uint32_t* Offset);
 void RcSetDefaultProbability(uint16_t* Probability);
@@ -79,6 +76,168 @@ void LzResetState(void);
 // LZMA2 Decoder
 //
 bool Lz2DecodeStream(uint32_t* BytesProcessed, bool GetSizeOnly);
+
+//
+// State used for the history buffer (dictionary)
+//
+typedef struct _DICTIONARY_STATE
+{
+    //
+    // Buffer, start position, current position, and offset limit in the buffer
+    //
+    uint8_t* Buffer;
+    uint32_t BufferSize;
+    uint32_t Start;
+    uint32_t Offset;
+    uint32_t Limit;
+} DICTIONARY_STATE, *PDICTIONARY_STATE;
+extern DICTIONARY_STATE Dictionary;
+
+//
+// State used for the binary adaptive arithmetic coder (LZMA Range Decoder)
+//
+typedef struct _RANGE_DECODER_STATE
+{
+    //
+    // Start and end location of the current stream's range encoder buffer
+    //
+    uint8_t* Start;
+    uint8_t* Limit;
+    //
+    // Next input byte, and the input buffer's soft limit. The range decoder
+    // reads its input directly through these while decoding a chunk, and only
+    // hands the position back to the input buffer code in RcIsComplete.
+    //
+    uint8_t* Position;
+    uint8_t* SoftLimit;
+    //
+    // Current probability range and 32-bit arithmetic encoded sequence code
+    //
+    uint32_t Range;
+    uint32_t Code;
+} RANGE_DECODER_STATE, *PRANGE_DECODER_STATE;
+extern RANGE_DECODER_STATE RcState;
+
+//
+// The range decoder uses 11 probability bits, where 2048 is 100% chance of a 0,
+// and adapts them with an exponential moving average with a shift of 5 bits.
+//
+#define LZMA_RC_PROBABILITY_BITS            11
+#define LZMA_RC_MAX_PROBABILITY             (1 << LZMA_RC_PROBABILITY_BITS)
+#define LZMA_RC_ADAPTATION_RATE_SHIFT       5
+
+//
+// The range decoder has enough precision for the range only as long as the top
+// 8 bits are still set. Once it falls below, it needs a renormalization step.
+//
+#define LZMA_RC_MIN_RANGE                   (1 << 24)
+
+//
+// The functions below run for every decoded bit or byte, so they are inlined
+// into their callers instead of living in rangedec.c and dictbuf.c.
+//
+static inline
+uint8_t
+DtGetSymbol (
+    uint32_t Distance
+    )
+{
+    //
+    // If the dictionary is still empty, just return 0, otherwise, return the
+    // symbol that is Distance bytes backward.
+    //
+    if (Distance > Dictionary.Offset)
+    {
+        return 0;
+    }
+    return Dictionary.Buffer[Dictionary.Offset - Distance];
+}
+
+static inline
+void
+DtPutSymbol (
+    uint8_t Symbol
+    )
+{
+    //
+    // Write the symbol and advance our position
+    //
+    Dictionary.Buffer[Dictionary.Offset++] = Symbol;
+}
+
+static inline
+void
+RcNormalize (
+    void
+    )
+{
+    //
+    // Whenever we drop below 24 bits, there is no longer enough precision in
+    // the probability range not to avoid a "stuck" state where we cannot tell
+    // apart the two branches (above/below the probability range) because the
+    // two options appear identical with the number of precision bits that we
+    // have. In this case, shift the state by a byte (8 bits) and read another.
+    // Past the soft limit, input reads as zeroes without advancing, exactly as
+    // BfRead does.
+    //
+    if (RcState.Range < LZMA_RC_MIN_RANGE)
+    {
+        RcState.Range <<= 8;
+        RcState.Code <<= 8;
+        if (RcState.Position < RcState.SoftLimit)
+        {
+            RcState.Code |= *RcState.Position++;
+        }
+    }
+}
+
+static inline
+uint8_t
+RcIsBitSet (
+    uint16_t* Probability
+    )
+{
+    uint32_t bound, range, code;
+    uint16_t prob;
+
+    //
+    // Always begin by making sure the range has been normalized for precision.
+    // Work on local copies, so that the compiler keeps them in registers.
+    //
+    RcNormalize();
+    range = RcState.Range;
+    code = RcState.Code;
+    prob = *Probability;
+
+    //
+    // Check if the current arithmetic code is descried by the next calculated
+    // proportionally-divided probability range. Recall that the probabilities
+    // encode the chance of the symbol (bit) being a 0 -- not a 1!
+    //
+    // Therefore, if the next chunk of the code lies outside of this new range,
+    // we are still on the path to our 0. Otherwise, if the code is now part of
+    // the newly defined range (inclusive), then we produce a 1 and limit the
+    // range to produce a new range and code for the next decoding pass.
+    //
+    // Either way, adapt the probability based on the bit value: in order to
+    // quickly adapt to change, LZMA uses an exponential moving average with a
+    // shift of 5, which lands exactly between 1 and the 10 probability bits.
+    // Each 0 increases the probability of another 0, and each 1 decreases it.
+    //
+    bound = (range >> LZMA_RC_PROBABILITY_BITS) * prob;
+    if (code < bound)
+    {
+        RcState.Range = bound;
+        *Probability = prob + ((LZMA_RC_MAX_PROBABILITY - prob) >>
+                               LZMA_RC_ADAPTATION_RATE_SHIFT);
+        return 0;
+    }
+    RcState.Range = range - bound;
+    RcState.Code = code - bound;
+    *Probability = prob - (prob >> LZMA_RC_ADAPTATION_RATE_SHIFT);
+    return 1;
+}
+
 #ifdef MINLZ_INTEGRITY_CHECKS
 //
 // Checksum Management
@@ -34,47 +34,17 @@ Environment:
 #include "minlzlib.h"
 
 //
-// The range decoder uses 11 probability bits, where 2048 is 100% chance of a 0
+// Probabilities start out at 50% (see minlzlib.h for the other range decoder
+// constants, which the inlined bit decoder there needs as well)
 //
-#define LZMA_RC_PROBABILITY_BITS            11
-#define LZMA_RC_MAX_PROBABILITY             (1 << LZMA_RC_PROBABILITY_BITS)
 const uint16_t k_LzmaRcHalfProbability = LZMA_RC_MAX_PROBABILITY / 2;
 
-//
-// The range decoder uses an exponential moving average of the last probability
-// hit (match or miss) with an adaptation rate of 5 bits (which falls in the
-// middle of its 11 bits used to encode a probability.
-//
-#define LZMA_RC_ADAPTATION_RATE_SHIFT   5
-
-//
-// The range decoder has enough precision for the range only as long as the top
-// 8 bits are still set. Once it falls below, it needs a renormalization step.
-//
-#define LZMA_RC_MIN_RANGE               (1 << 24)
-
 //
 // The range decoder must be initialized with 5 bytes, the first of which is
 // ignored
 //
 #define LZMA_RC_INIT_BYTES              5
 
-//
-// State used for the binary adaptive arithmetic coder (LZMA Range Decoder)
-//
-typedef struct _RANGE_DECODER_STATE
-{
-    //
-    // Start and end location of the current stream's range encoder buffer
-    //
-    uint8_t* Start;
-    uint8_t* Limit;
-    //
-    // Current probability range and 32-bit arithmetic encoded sequence code
-    //
-    uint32_t Range;
-    uint32_t Code;
-} RANGE_DECODER_STATE, *PRANGE_DECODER_STATE;
 RANGE_DECODER_STATE RcState;
 
 bool
@@ -118,6 +88,8 @@ RcInitialize (
     //
     BfSeek(0, &RcState.Start);
     RcState.Limit = RcState.Start + *ChunkSize;
+    RcState.Position = RcState.Start;
+    RcState.SoftLimit = BfGetSoftLimit();
     *ChunkSize -= LZMA_RC_INIT_BYTES;
     return true;
 }
@@ -127,13 +99,11 @@ RcCanRead (
     void
     )
 {
-    uint8_t* pos;
     //
     // We can keep reading symbols as long as we haven't reached the end of the
     // input buffer yet.
     //
-    BfSeek(0, &pos);
-    return pos <= RcState.Limit;
+    return RcState.Position <= RcState.Limit;
 }
 
 bool
@@ -147,102 +117,15 @@ RcIsComplete (
     // there is nothing left to describe. Return the offset in the buffer where
     // this occurred (which should be equal to the compressed size).
     //
+    // Since we have been reading directly from the buffer, this is also where
+    // the input buffer catches up with everything we consumed.
+    //
     BfSeek(0, &pos);
-    *BytesProcessed = (uint32_t)(pos - RcState.Start);
+    BfSeek((uint32_t)(RcState.Position - pos), &pos);
+    *BytesProcessed = (uint32_t)(RcState.Position - RcState.Start);
     return (RcState.Code == 0);
 }
 
-void
-RcNormalize (
-    void
-    )
-{
-    uint8_t rcByte;
-    //
-    // Whenever we drop below 24 bits, there is no longer enough precision in
-    // the probability range not to avoid a "stuck" state where we cannot tell
-    // apart the two branches (above/below the probability range) because the
-    // two options appear identical with the number of precision bits that we
-    // have. In this case, shift the state by a byte (8 bits) and read another.
-    //
-    if (RcState.Range < LZMA_RC_MIN_RANGE)
-    {
-        RcState.Range <<= 8;
-        RcState.Code <<= 8;
-        BfRead(&rcByte);
-        RcState.Code |= rcByte;
-    }
-}
-
-void
-RcAdapt (
-    bool Miss,
-    uint16_t* Probability
-    )
-{
-    //
-    // In the canonical range encoders out there (including this one used by
-    // LZMA, we want the probability to adapt (change) as we read more or less
-    // bits that match our expectation. In order to quickly adapt to change,
-    // use an exponential moving average. The standard way of doing this is to
-    // use an integer based adaptation with a shift that's somewhere between
-    // {1, bits-1}. Since LZMA uses 11 bits for its model, 5 is a nice number
-    // that lands exactly between 1 and 10.
-    //
-    if (Miss)
-    {
-        *Probability -= *Probability >> LZMA_RC_ADAPTATION_RATE_SHIFT;
-    }
-    else
-    {
-        *Probability += (LZMA_RC_MAX_PROBABILITY - *Probability) >>
-                        LZMA_RC_ADAPTATION_RATE_SHIFT;
-    }
-}
-
-uint8_t
-RcIsBitSet (
-    uint16_t* Probability
-    )
-{
-    uint32_t bound;
-    uint8_t bit;
-
-    //
-    // Always begin by making sure the range has been normalized for precision
-    //
-    RcNormalize();
-
-    //
-    // Check if the current arithmetic code is descried by the next calculated
-    // proportionally-divided probability range. Recall that the probabilities
-    // encode the chance of the symbol (bit) being a 0 -- not a 1!
-    //
-    // Therefore, if the next chunk of the code lies outside of this new range,
-    // we are still on the path to our 0. Otherwise, if the code is now part of
-    // the newly defined range (inclusive), then we produce a 1 and limit the
-    // range to produce a new range and code for the next decoding pass.
-    //
-    bound = (RcState.Range >> LZMA_RC_PROBABILITY_BITS) * *Probability;
-    if (RcState.Code < bound)
-    {
-        RcState.Range = bound;
-        bit = 0;
-    }
-    else
-    {
-        RcState.Range -= bound;
-        RcState.Code -= bound;
-        bit = 1;
-    }
-
-    //
-    // Always finish by adapt the probabilities based on the bit value
-    //
-    RcAdapt(bit, Probability);
-    return bit;
-}
-
 uint8_t
 RcIsFixedBitSet(
     void
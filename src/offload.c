@@ -0,0 +1,103 @@
+/* SPDX-License-Identifier: MIT */
+
+#include "offload.h"
+#include "exception.h"
+#include "memory.h"
+#include "sched.h"
+#include "smp.h"
+#include "utils.h"
+
+/*
+ * The boot CPU is an Icestorm (efficiency) core. Long-running work such as decompression and
+ * large memory operations is handed off to an idle Firestorm core through the SMP mailbox, while
+ * the boot CPU keeps running background tasks (see sched.h) until the job completes.
+ */
+
+struct offload_job {
+    generic_func *func;
+    u64 args[4];
+    enum exc_guard_t guard;
+};
+
+static struct offload_job offload_job;
+
+static u64 offload_trampoline(u64 job_addr)
+{
+    struct offload_job *job = (struct offload_job *)job_addr;
+
+    // Secondaries idle with the MMU off; turn it on so the job runs cached and coherent with
+    // the boot CPU, and turn it off again afterwards so the core can still be handed to a kernel.
+    mmu_init_secondary();
+    exc_guard = job->guard;
+    u64 ret = job->func(job->args[0], job->args[1], job->args[2], job->args[3]);
+    job->guard = exc_guard;
+    exc_guard = GUARD_OFF;
+    mmu_disable();
+
+    return ret;
+}
+
+static bool offload_cpu_usable(int cpu)
+{
+    if (!smp_is_alive(cpu) || smp_is_busy(cpu))
+        return false;
+
+    // MPIDR.Aff2 selects the cluster: 0 for Icestorm, 1 for Firestorm
+    return smp_get_mpidr(cpu) & BIT(16);
+}
+
+int offload_get_cpu(void)
+{
+    for (int cpu = 1; cpu < MAX_CPUS; cpu++) {
+        if (offload_cpu_usable(cpu))
+            return cpu;
+    }
+
+    return -1;
+}
+
+// Fills cpus with up to max idle Firestorm cores, for work that can be split between them
+int offload_get_cpus(int *cpus, int max)
+{
+    int count = 0;
+
+    for (int cpu = 1; cpu < MAX_CPUS && count < max; cpu++) {
+        if (offload_cpu_usable(cpu))
+            cpus[count++] = cpu;
+    }
+
+    return count;
+}
+
+u64 offload_call(void *func, u64 a, u64 b, u64 c, u64 d)
+{
+    int cpu = offload_get_cpu();
+
+    if (cpu < 0)
+        return ((generic_func *)func)(a, b, c, d);
+
+    offload_job.func = (generic_func *)func;
+    offload_job.args[0] = a;
+    offload_job.args[1] = b;
+    offload_job.args[2] = c;
+    offload_job.args[3] = d;
+    // The caller's exception guard moves to the secondary, and comes back once the job is done
+    offload_job.guard = exc_guard;
+
+    smp_call4(cpu, (void *)offload_trampoline, (u64)&offload_job, 0, 0, 0);
+
+    while (smp_is_busy(cpu))
+        sched_yield();
+
+    u64 ret = smp_wait(cpu);
+    exc_guard = offload_job.guard;
+    return ret;
+}
+
+u64 offload_call_sized(size_t size, void *func, u64 a, u64 b, u64 c, u64 d)
+{
+    if (size < OFFLOAD_MIN_SIZE)
+        return ((generic_func *)func)(a, b, c, d);
+
+    return offload_call(func, a, b, c, d);
+}
@@ -0,0 +1,17 @@
+/* SPDX-License-Identifier: MIT */
+
+#ifndef OFFLOAD_H
+#define OFFLOAD_H
+
+#include "types.h"
+#include "utils.h"
+
+// Below this size, the MMU setup and cache maintenance on the target core costs more than it saves
+#define OFFLOAD_MIN_SIZE (1 << 20)
+
+int offload_get_cpu(void);
+int offload_get_cpus(int *cpus, int max);
+u64 offload_call(void *func, u64 a, u64 b, u64 c, u64 d);
+u64 offload_call_sized(size_t size, void *func, u64 a, u64 b, u64 c, u64 d);
+
+#endif
@@ -2,8 +2,11 @@
 
 #include "payload.h"
 #include "assert.h"
+#include "gzip.h"
 #include "heapblock.h"
 #include "kboot.h"
+#include "lzfse.h"
+#include "offload.h"
 #include "smp.h"
 #include "utils.h"
 
@@ -19,6 +22,7 @@ const u8 xz_magic[] = {0xfd, '7', 'z', 'X', 'Z', 0x00};
 const u8 fdt_magic[] = {0xd0, 0x0d, 0xfe, 0xed};
 const u8 kernel_magic[] = {'A', 'R', 'M', 0x64};   // at 0x38
 const u8 cpio_magic[] = {'0', '7', '0', '7', '0'}; // '1' or '2' next
+const u8 lzfse_magic[] = {'b', 'v', 'x'};          // block type next
 const u8 empty[] = {0, 0, 0, 0};
 
 struct kernel_header *kernel = NULL;
@@ -43,50 +47,128 @@ static void finalize_uncompression(void *dest, size_t dest_len)
     }
 }
 
+struct decompress_args {
+    void *src;
+    void *dest;
+    u32 source_len;
+    u32 dest_len;
+};
+
+static u64 gz_worker(u64 args_addr)
+{
+    struct decompress_args *args = (struct decompress_args *)args_addr;
+
+    return tinf_gzip_uncompress(args->dest, &args->dest_len, args->src, &args->source_len);
+}
+
+static u64 xz_worker(u64 args_addr)
+{
+    struct decompress_args *args = (struct decompress_args *)args_addr;
+
+    return XzDecode(args->src, &args->source_len, args->dest, &args->dest_len);
+}
+
+static u64 lzfse_worker(u64 args_addr)
+{
+    struct decompress_args *args = (struct decompress_args *)args_addr;
+    size_t source_len = args->source_len, dest_len = args->dest_len;
+
+    int ret = lzfse_decode(args->dest, &dest_len, args->src, &source_len);
+    args->source_len = source_len;
+    args->dest_len = dest_len;
+
+    return ret;
+}
+
 static void *decompress_gz(void *p, size_t size)
 {
-    unsigned int source_len = size, dest_len = 1 << 30; // 1 GiB should be enough hopefully
+    struct decompress_args args = {
+        .src = p,
+        .source_len = size,
+        .dest_len = 1 << 30, // 1 GiB should be enough hopefully
+    };
 
     // Start at the end of the heap area, no allocation yet. The following code must not use
     // malloc or heapblock, until finalize_uncompression is called.
-    void *dest = heapblock_alloc_aligned(0, KERNEL_ALIGN);
-
-    printf("Uncompressing... ");
-    int ret = tinf_gzip_uncompress(dest, &dest_len, p, &source_len);
+    args.dest = heapblock_alloc_aligned(0, KERNEL_ALIGN);
+
+    struct gzip_par par;
+    int ret = gzip_par_init(&par, args.dest, args.dest_len, p, size);
+
+    if (ret > 0) {
+        printf("Uncompressing %d members in parallel... ", par.count);
+        ret = gzip_par_run(&par);
+        args.source_len = par.src_len;
+        args.dest_len = par.dest_len;
+    } else if (ret == 0) {
+        printf("Uncompressing... ");
+        ret = offload_call(gz_worker, (u64)&args, 0, 0, 0);
+    }
 
     if (ret != TINF_OK) {
         printf("Error %d\n", ret);
         return NULL;
     }
 
-    printf("%d bytes uncompressed to %d bytes\n", source_len, dest_len);
+    printf("%d bytes uncompressed to %d bytes\n", args.source_len, args.dest_len);
 
-    finalize_uncompression(dest, dest_len);
+    finalize_uncompression(args.dest, args.dest_len);
 
-    return ((u8 *)p) + source_len;
+    return ((u8 *)p) + args.source_len;
 }
 
 static void *decompress_xz(void *p, size_t size)
 {
-    uint32_t source_len = size, dest_len = 1 << 30; // 1 GiB should be enough hopefully
+    struct decompress_args args = {
+        .src = p,
+        .source_len = size,
+        .dest_len = 1 << 30, // 1 GiB should be enough hopefully
+    };
 
     // Start at the end of the heap area, no allocation yet. The following code must not use
     // malloc or heapblock, until finalize_uncompression is called.
-    void *dest = heapblock_alloc_aligned(0, KERNEL_ALIGN);
+    args.dest = heapblock_alloc_aligned(0, KERNEL_ALIGN);
 
     printf("Uncompressing... ");
-    int ret = XzDecode(p, &source_len, dest, &dest_len);
+    int ret = offload_call(xz_worker, (u64)&args, 0, 0, 0);
 
     if (!ret) {
         printf("XZ decode failed\n");
         return NULL;
     }
 
-    printf("%d bytes uncompressed to %d bytes\n", source_len, dest_len);
+    printf("%d bytes uncompressed to %d bytes\n", args.source_len, args.dest_len);
 
-    finalize_uncompression(dest, dest_len);
+    finalize_uncompression(args.dest, args.dest_len);
 
-    return ((u8 *)p) + source_len;
+    return ((u8 *)p) + args.source_len;
+}
+
+static void *decompress_lzfse(void *p, size_t size)
+{
+    struct decompress_args args = {
+        .src = p,
+        .source_len = size,
+        .dest_len = 1 << 30, // 1 GiB should be enough hopefully
+    };
+
+    // Start at the end of the heap area, no allocation yet. The following code must not use
+    // malloc or heapblock, until finalize_uncompression is called.
+    args.dest = heapblock_alloc_aligned(0, KERNEL_ALIGN);
+
+    printf("Uncompressing... ");
+    int ret = offload_call(lzfse_worker, (u64)&args, 0, 0, 0);
+
+    if (ret) {
+        printf("LZFSE decode failed (%d)\n", ret);
+        return NULL;
+    }
+
+    printf("%d bytes uncompressed to %d bytes\n", args.source_len, args.dest_len);
+
+    finalize_uncompression(args.dest, args.dest_len);
+
+    return ((u8 *)p) + args.source_len;
 }
 
 static void *load_fdt(void *p, size_t size)
@@ -148,6 +230,9 @@ static void *load_one_payload(void *start, size_t size)
     } else if (!memcmp(p, xz_magic, sizeof xz_magic)) {
         printf("Found an XZ compressed payload at %p\n", p);
         return decompress_xz(p, size);
+    } else if (!memcmp(p, lzfse_magic, sizeof lzfse_magic) && lzfse_check_magic(p)) {
+        printf("Found an LZFSE compressed payload at %p\n", p);
+        return decompress_lzfse(p, size);
     } else if (!memcmp(p, fdt_magic, sizeof fdt_magic)) {
         printf("Found a devicetree at %p\n", p);
         return load_fdt(p, size);
@@ -170,12 +255,14 @@ int payload_run(void)
 {
     void *p = _payload_start;
 
+    // Bring the secondaries up first, so decompression can be offloaded to a Firestorm core
+    if (memcmp(p, empty, sizeof empty))
+        smp_start_secondaries();
+
     while (p)
         p = load_one_payload(p, 0);
 
     if (kernel && fdt) {
-        smp_start_secondaries();
-
         if (kboot_prepare_dt(fdt)) {
             printf("Failed to prepare FDT!");
             return -1;
@@ -1,17 +1,24 @@
 /* SPDX-License-Identifier: MIT */
 
 #include "proxy.h"
+#include "adt.h"
 #include "dart.h"
 #include "exception.h"
 #include "fb.h"
 #include "gxf.h"
+#include "gzip.h"
 #include "heapblock.h"
 #include "hv.h"
 #include "iodev.h"
 #include "kboot.h"
+#include "lzfse.h"
+#include "macho.h"
 #include "malloc.h"
 #include "memory.h"
+#include "offload.h"
 #include "pmgr.h"
+#include "proxy_job.h"
+#include "sched.h"
 #include "smp.h"
 #include "string.h"
 #include "tunables.h"
@@ -24,6 +31,95 @@
 #include "minilzlib/minlzma.h"
 #include "tinf/tinf.h"
 
+u64 proxy_xzdec(u64 src, u64 srclen, u64 dst, u64 dstlen)
+{
+    uint32_t destlen = dstlen, srclen32 = srclen;
+
+    if (XzDecode((void *)src, &srclen32, (void *)dst, &destlen))
+        return destlen;
+    else
+        return ~0L;
+}
+
+u64 proxy_gzdec(u64 src, u64 srclen, u64 dst, u64 dstlen)
+{
+    unsigned int destlen = dstlen, srclen32 = srclen;
+
+    size_t ret = tinf_gzip_uncompress((void *)dst, &destlen, (void *)src, &srclen32);
+    if (ret != TINF_OK)
+        return ret;
+    else
+        return destlen;
+}
+
+u64 proxy_lzfsedec(u64 src, u64 srclen, u64 dst, u64 dstlen)
+{
+    size_t destlen = dstlen, srclen64 = srclen;
+
+    int ret = lzfse_decode((void *)dst, &destlen, (void *)src, &srclen64);
+    if (ret)
+        return ret;
+    else
+        return destlen;
+}
+
+/*
+ * Large copies and fills that cannot be offloaded to another core are done in chunks, so
+ * background tasks get to run in between.
+ */
+#define PROXY_MEMOP_CHUNK SZ_1M
+
+static void proxy_memop(bool copy, int width, u64 dst, u64 arg, u64 size)
+{
+    enum exc_guard_t guard = exc_guard;
+    u64 chunk = size;
+
+    if (size >= OFFLOAD_MIN_SIZE && offload_get_cpu() < 0)
+        chunk = PROXY_MEMOP_CHUNK;
+
+    while (size) {
+        u64 len = min(size, chunk);
+        void *func = copy ? mem_copy_func((void *)dst, (void *)arg, len, width)
+                          : mem_fill_func((void *)dst, arg, len, width);
+
+        exc_guard = GUARD_RETURN;
+        offload_call_sized(len, func, dst, arg, len, 0);
+        // A fault clears the guard; stop there, like a single call would
+        if (exc_guard != GUARD_RETURN)
+            return;
+        exc_guard = guard;
+
+        dst += len;
+        if (copy)
+            arg += len;
+        size -= len;
+
+        if (size)
+            sched_yield();
+    }
+}
+
+static int proxy_adt_edit(u64 op, void *dt, size_t bufsize, const char *path, const char *name,
+                          const void *value, size_t len)
+{
+    int parent;
+    int node = adt_path_offset_parent(dt, path, &parent);
+
+    if (node < 0)
+        return node;
+
+    switch (op) {
+        case P_ADT_SETPROP:
+            return adt_setprop(dt, bufsize, node, name, value, len);
+        case P_ADT_DELPROP:
+            return adt_delprop(dt, node, name);
+        case P_ADT_DEL_NODE:
+            return adt_del_node(dt, parent, node);
+        default:
+            return -ADT_ERR_BADVALUE;
+    }
+}
+
 int proxy_process(ProxyRequest *request, ProxyReply *reply)
 {
     enum exc_guard_t guard_save = exc_guard;
@@ -35,6 +131,8 @@ int proxy_process(ProxyRequest *request, ProxyReply *reply)
         case P_NOP:
             break;
         case P_EXIT:
+            // Optional value handed back to the code waiting in uartproxy_run_inline()
+            reply->retval = request->args[1];
             if (request->args[0])
                 return request->args[0];
             return 1;
@@ -52,6 +150,7 @@ int proxy_process(ProxyRequest *request, ProxyReply *reply)
             break;
         case P_SET_BAUD: {
             int cnt = request->args[1];
+            int old = uart_getbaud();
             printf("Changing baud rate to %lu...\n", request->args[0]);
             uart_setbaud(request->args[0]);
             while (cnt--) {
@@ -60,6 +159,12 @@ int proxy_process(ProxyRequest *request, ProxyReply *reply)
                 uart_putbyte(request->args[2] >> 16);
                 uart_putbyte(request->args[2] >> 24);
             }
+            reply->retval = request->args[0];
+            // With a timeout given, go back to the old rate unless the host echoes the sync word
+            if (request->args[3] && !uart_wait_word(request->args[2], request->args[3])) {
+                uart_setbaud(old);
+                reply->retval = old;
+            }
             break;
         }
         case P_UDELAY:
@@ -89,6 +194,20 @@ int proxy_process(ProxyRequest *request, ProxyReply *reply)
             reply->retval = gl2_call((void *)request->args[0], request->args[1], request->args[2],
                                      request->args[3], request->args[4]);
             break;
+        case P_SPRR_SWEEP:
+            reply->retval = gxf_sprr_sweep(request->args[0], request->args[1], request->args[2],
+                                           (u8 *)request->args[3]);
+            break;
+        case P_SPRR_USED_INDICES:
+            reply->retval = mmu_sprr_used_indices();
+            break;
+        case P_GET_FEATURES:
+            reply->retval = PROXY_FEAT_INLINE_HOOK | PROXY_FEAT_MEMREAD_TRAILER |
+                            PROXY_FEAT_BAUD_CONFIRM | PROXY_FEAT_MMIOTRACE_DELTA |
+                            PROXY_FEAT_ASYNC_JOBS | PROXY_FEAT_ADT_EDIT |
+                            PROXY_FEAT_SPRR_SWEEP | PROXY_FEAT_GZIP_MEMBERS |
+                            PROXY_FEAT_MACHO_LOAD | PROXY_FEAT_LZFSE | PROXY_FEAT_TRACE_TIME;
+            break;
         case P_VECTOR:
             next_stage.entry = (generic_func *)request->args[0];
             memcpy(next_stage.args, &request->args[1], 4 * sizeof(u64));
@@ -197,37 +316,29 @@ int proxy_process(ProxyRequest *request, ProxyReply *reply)
             break;
 
         case P_MEMCPY64:
-            exc_guard = GUARD_RETURN;
-            memcpy64((void *)request->args[0], (void *)request->args[1], request->args[2]);
+            proxy_memop(true, 64, request->args[0], request->args[1], request->args[2]);
             break;
         case P_MEMCPY32:
-            exc_guard = GUARD_RETURN;
-            memcpy32((void *)request->args[0], (void *)request->args[1], request->args[2]);
+            proxy_memop(true, 32, request->args[0], request->args[1], request->args[2]);
             break;
         case P_MEMCPY16:
-            exc_guard = GUARD_RETURN;
-            memcpy16((void *)request->args[0], (void *)request->args[1], request->args[2]);
+            proxy_memop(true, 16, request->args[0], request->args[1], request->args[2]);
             break;
         case P_MEMCPY8:
-            exc_guard = GUARD_RETURN;
-            memcpy8((void *)request->args[0], (void *)request->args[1], request->args[2]);
+            proxy_memop(true, 8, request->args[0], request->args[1], request->args[2]);
             break;
 
         case P_MEMSET64:
-            exc_guard = GUARD_RETURN;
-            memset64((void *)request->args[0], request->args[1], request->args[2]);
+            proxy_memop(false, 64, request->args[0], request->args[1], request->args[2]);
             break;
         case P_MEMSET32:
-            exc_guard = GUARD_RETURN;
-            memset32((void *)request->args[0], request->args[1], request->args[2]);
+            proxy_memop(false, 32, request->args[0], request->args[1], request->args[2]);
             break;
         case P_MEMSET16:
-            exc_guard = GUARD_RETURN;
-            memset16((void *)request->args[0], request->args[1], request->args[2]);
+            proxy_memop(false, 16, request->args[0], request->args[1], request->args[2]);
             break;
         case P_MEMSET8:
-            exc_guard = GUARD_RETURN;
-            memset8((void *)request->args[0], request->args[1], request->args[2]);
+            proxy_memop(false, 8, request->args[0], request->args[1], request->args[2]);
             break;
 
         case P_IC_IALLUIS:
@@ -276,28 +387,35 @@ int proxy_process(ProxyRequest *request, ProxyReply *reply)
             mmu_restore(request->args[0]);
             break;
 
-        case P_XZDEC: {
-            uint32_t destlen, srclen;
-            destlen = request->args[3];
-            srclen = request->args[1];
-            if (XzDecode((void *)request->args[0], &srclen, (void *)request->args[2], &destlen))
-                reply->retval = destlen;
-            else
-                reply->retval = ~0L;
+        case P_XZDEC:
+            reply->retval = offload_call(proxy_xzdec, request->args[0], request->args[1],
+                                         request->args[2], request->args[3]);
             break;
-        }
         case P_GZDEC: {
-            unsigned int destlen, srclen;
-            destlen = request->args[3];
-            srclen = request->args[1];
-            size_t ret = tinf_gzip_uncompress((void *)request->args[2], &destlen,
-                                              (void *)request->args[0], &srclen);
-            if (ret != TINF_OK)
+            struct gzip_par par;
+            int ret = gzip_par_init(&par, (void *)request->args[2], request->args[3],
+                                    (void *)request->args[0], request->args[1]);
+
+            if (ret > 0) {
+                ret = gzip_par_run(&par);
+                reply->retval = ret == TINF_OK ? par.dest_len : (u64)ret;
+            } else if (ret < 0) {
                 reply->retval = ret;
-            else
-                reply->retval = destlen;
+            } else {
+                reply->retval = offload_call(proxy_gzdec, request->args[0], request->args[1],
+                                             request->args[2], request->args[3]);
+            }
             break;
         }
+        case P_MACHO_LOAD:
+            reply->retval = macho_load((const void *)request->args[0], request->args[1],
+                                       (void *)request->args[2], request->args[3],
+                                       (struct macho_info *)request->args[4]);
+            break;
+        case P_LZFSEDEC:
+            reply->retval = offload_call(proxy_lzfsedec, request->args[0], request->args[1],
+                                         request->args[2], request->args[3]);
+            break;
 
         case P_SMP_START_SECONDARIES:
             smp_start_secondaries();
@@ -418,6 +536,21 @@ int proxy_process(ProxyRequest *request, ProxyReply *reply)
         case P_HV_MAP_VUART:
             hv_map_vuart(request->args[0], request->args[1]);
             break;
+        case P_HV_SET_PVCON:
+            hv_set_pvcon(request->args[0]);
+            break;
+        case P_HV_SET_TIME_COMP:
+            hv_set_time_comp(request->args[0], request->args[1]);
+            break;
+        case P_HV_GET_TIME_COMP_STATS:
+            reply->retval = (u64)hv_get_time_comp_stats();
+            break;
+        case P_HV_RESET_VCPU:
+            hv_reset_vcpu();
+            break;
+        case P_HV_SET_TRACE_TIME:
+            hv_set_trace_time(request->args[0]);
+            break;
 
         case P_FB_INIT:
             fb_init();
@@ -447,6 +580,41 @@ int proxy_process(ProxyRequest *request, ProxyReply *reply)
             fb_restore_logo();
             break;
 
+        case P_JOB_SUBMIT:
+            reply->retval = job_submit(request->args[0], &request->args[1]);
+            break;
+        case P_JOB_STATUS:
+            reply->retval = (u64)job_get_status(request->args[0]);
+            break;
+        case P_JOB_WAIT:
+            reply->retval = job_wait(request->args[0], request->args[1]);
+            break;
+        case P_JOB_CANCEL:
+            reply->retval = job_cancel(request->args[0]);
+            break;
+        case P_JOB_RELEASE:
+            reply->retval = job_release(request->args[0]);
+            break;
+
+        case P_ADT_GET_SIZE:
+            reply->retval = adt_get_size((void *)request->args[0]);
+            break;
+        case P_ADT_SETPROP:
+            reply->retval = proxy_adt_edit(request->opcode, (void *)request->args[0],
+                                           request->args[1], (const char *)request->args[2],
+                                           (const char *)request->args[3],
+                                           (const void *)request->args[4], request->args[5]);
+            break;
+        case P_ADT_DELPROP:
+            reply->retval = proxy_adt_edit(request->opcode, (void *)request->args[0], 0,
+                                           (const char *)request->args[1],
+                                           (const char *)request->args[2], NULL, 0);
+            break;
+        case P_ADT_DEL_NODE:
+            reply->retval = proxy_adt_edit(request->opcode, (void *)request->args[0], 0,
+                                           (const char *)request->args[1], NULL, NULL, 0);
+            break;
+
         default:
             reply->status = S_BADCMD;
             break;
@@ -5,6 +5,19 @@
 
 #include "types.h"
 
+// Protocol features reported by P_GET_FEATURES
+#define PROXY_FEAT_INLINE_HOOK     BIT(0) // START_HV_HOOK carries hook data inline
+#define PROXY_FEAT_MEMREAD_TRAILER BIT(1) // MEMREAD data is followed by a checksum trailer
+#define PROXY_FEAT_BAUD_CONFIRM    BIT(2) // P_SET_BAUD can revert unless confirmed
+#define PROXY_FEAT_MMIOTRACE_DELTA BIT(3) // MMIO traces use EVT_MMIOTRACE_DELTA
+#define PROXY_FEAT_ASYNC_JOBS      BIT(4) // P_JOB_* ops and EVT_JOB are available
+#define PROXY_FEAT_ADT_EDIT        BIT(5) // P_ADT_* in-place ADT edit ops are available
+#define PROXY_FEAT_SPRR_SWEEP      BIT(6) // P_SPRR_SWEEP and P_SPRR_USED_INDICES are available
+#define PROXY_FEAT_GZIP_MEMBERS    BIT(7) // P_GZDEC decodes multi-member streams in parallel
+#define PROXY_FEAT_MACHO_LOAD      BIT(8) // P_MACHO_LOAD is available
+#define PROXY_FEAT_LZFSE           BIT(9) // P_LZFSEDEC is available, also as a job
+#define PROXY_FEAT_TRACE_TIME      BIT(10) // P_HV_SET_TRACE_TIME is available
+
 typedef enum {
     P_NOP = 0x000, // System functions
     P_EXIT,
@@ -20,6 +33,9 @@ typedef enum {
     P_VECTOR,
     P_GL1_CALL,
     P_GL2_CALL,
+    P_GET_FEATURES,
+    P_SPRR_SWEEP,
+    P_SPRR_USED_INDICES,
 
     P_WRITE64 = 0x100, // Generic register functions
     P_WRITE32,
@@ -73,6 +89,8 @@ typedef enum {
 
     P_XZDEC = 0x400, // Decompression and data processing ops
     P_GZDEC,
+    P_MACHO_LOAD,
+    P_LZFSEDEC,
 
     P_SMP_START_SECONDARIES = 0x500, // SMP and system management ops
     P_SMP_CALL,
@@ -115,6 +133,11 @@ typedef enum {
     P_HV_TRANSLATE,
     P_HV_PT_WALK,
     P_HV_MAP_VUART,
+    P_HV_SET_PVCON,
+    P_HV_SET_TIME_COMP,
+    P_HV_GET_TIME_COMP_STATS,
+    P_HV_RESET_VCPU,
+    P_HV_SET_TRACE_TIME,
 
     P_FB_INIT = 0xd00,
     P_FB_SHUTDOWN,
@@ -125,6 +148,17 @@ typedef enum {
     P_FB_DISPLAY_LOGO,
     P_FB_RESTORE_LOGO,
 
+    P_JOB_SUBMIT = 0xe00, // Asynchronous jobs (see proxy_job.c)
+    P_JOB_STATUS,
+    P_JOB_WAIT,
+    P_JOB_CANCEL,
+    P_JOB_RELEASE,
+
+    P_ADT_GET_SIZE = 0xf00, // In-place ADT edits, all return the new size or a negative error
+    P_ADT_SETPROP,
+    P_ADT_DELPROP,
+    P_ADT_DEL_NODE,
+
 } ProxyOp;
 
 #define S_OK     0
@@ -143,4 +177,8 @@ typedef struct {
 
 int proxy_process(ProxyRequest *request, ProxyReply *reply);
 
+u64 proxy_xzdec(u64 src, u64 srclen, u64 dst, u64 dstlen);
+u64 proxy_gzdec(u64 src, u64 srclen, u64 dst, u64 dstlen);
+u64 proxy_lzfsedec(u64 src, u64 srclen, u64 dst, u64 dstlen);
+
 #endif
@@ -0,0 +1,312 @@
+/* SPDX-License-Identifier: MIT */
+
+#include "proxy_job.h"
+#include "exception.h"
+#include "gzip.h"
+#include "memory.h"
+#include "offload.h"
+#include "proxy.h"
+#include "sched.h"
+#include "smp.h"
+#include "string.h"
+#include "uartproxy.h"
+#include "utils.h"
+
+#include "tinf/tinf.h"
+
+/*
+ * Asynchronous proxy ops. P_JOB_SUBMIT starts a memcpy/memset, gzdec, xzdec or lzfsedec in the
+ * background and replies with a job ID right away, so the link stays usable. Jobs go to an idle
+ * Firestorm core when there is one (see offload.c). Otherwise they run from the run-loop on the
+ * boot CPU: memory ops in chunks, and decompression, which cannot be split up, in one go on the
+ * first tick after P_JOB_SUBMIT has replied. Requests are not served in the meantime, so the
+ * host must not time out while waiting on such a job. EVT_JOB events report progress and
+ * completion.
+ *
+ * A gzdec job on a multi-member stream with a member table (see gzip.h) is spread over all
+ * idle Firestorm cores instead, and polled from the run-loop. With no idle core, the run-loop
+ * decompresses one member per tick.
+ *
+ * Cancellation stops memory ops at the next chunk. A decompression job cannot be interrupted:
+ * it runs to the end and is then reported as cancelled. A fault in a memory op fails the job,
+ * on whichever core it runs.
+ */
+
+#define JOB_MAX                  8
+#define JOB_CHUNK                SZ_1M
+#define JOB_PROGRESS_INTERVAL_US 100000
+
+struct job {
+    struct job_status status;
+    u64 opcode;
+    u64 args[5];
+    int cpu; // -1 if run from the run-loop on the boot CPU
+    bool par;
+    struct gzip_par gzip;
+    volatile bool cancel;
+    bool reported;
+    u64 last_event;
+    u64 last_progress;
+};
+
+static struct job jobs[JOB_MAX];
+static u32 job_next_id = 1;
+
+static inline u64 job_ticks(u64 us)
+{
+    return us * (mrs(CNTFRQ_EL0) / 1000000);
+}
+
+static inline bool job_is_memop(u64 opcode)
+{
+    return opcode >= P_MEMCPY64 && opcode <= P_MEMSET8;
+}
+
+static struct job *job_find(u32 id)
+{
+    for (int i = 0; i < JOB_MAX; i++) {
+        if (id && jobs[i].status.state != JOB_FREE && jobs[i].status.id == id)
+            return &jobs[i];
+    }
+
+    return NULL;
+}
+
+/*
+ * Do the next chunk of a memory op under GUARD_RETURN; a fault fails the job. On a secondary the
+ * guard is silent, so that the exception report does not land in the middle of proxy traffic.
+ */
+static bool job_memop_step(struct job *job)
+{
+    bool copy = job->opcode < P_MEMSET64;
+    int width = 64 >> ((job->opcode - P_MEMCPY64) & 3);
+    u64 done = job->status.progress;
+    u64 len = min(job->status.total - done, JOB_CHUNK);
+    u64 dst = job->args[0] + done;
+    u64 arg = copy ? job->args[1] + done : job->args[1];
+    void *func = copy ? mem_copy_func((void *)dst, (void *)arg, len, width)
+                      : mem_fill_func((void *)dst, arg, len, width);
+    enum exc_guard_t guard = exc_guard;
+
+    exc_guard = job->cpu < 0 ? GUARD_RETURN : GUARD_RETURN | GUARD_SILENT;
+    ((generic_func *)func)(dst, arg, len, 0);
+    // GUARD_RETURN clears the guard when it catches a fault
+    if (exc_guard == GUARD_OFF) {
+        exc_guard = guard;
+        job->status.state = JOB_FAILED;
+        return false;
+    }
+    exc_guard = guard;
+
+    job->status.progress = done + len;
+    return job->status.progress < job->status.total;
+}
+
+static u64 job_run_decompress(struct job *job)
+{
+    u64 ret;
+
+    if (job->opcode == P_GZDEC)
+        ret = proxy_gzdec(job->args[0], job->args[1], job->args[2], job->args[3]);
+    else if (job->opcode == P_LZFSEDEC)
+        ret = proxy_lzfsedec(job->args[0], job->args[1], job->args[2], job->args[3]);
+    else
+        ret = proxy_xzdec(job->args[0], job->args[1], job->args[2], job->args[3]);
+
+    job->status.progress = job->status.total;
+    return ret;
+}
+
+static void job_finish(struct job *job, u64 retval)
+{
+    job->status.retval = retval;
+    sysop("dmb sy");
+    if (job->status.state == JOB_RUNNING)
+        job->status.state = job->cancel ? JOB_CANCELLED : JOB_DONE;
+    sysop("dmb sy");
+}
+
+static u64 job_trampoline(u64 addr)
+{
+    struct job *job = (struct job *)addr;
+    u64 ret = 0;
+
+    mmu_init_secondary();
+
+    if (job_is_memop(job->opcode)) {
+        while (!job->cancel && job_memop_step(job))
+            ;
+    } else {
+        ret = job_run_decompress(job);
+    }
+    job_finish(job, ret);
+
+    mmu_disable();
+
+    return ret;
+}
+
+static void job_report(struct job *job, bool force)
+{
+    u64 now = mrs(CNTPCT_EL0);
+    struct job_status status = job->status;
+
+    if (job->reported)
+        return;
+
+    if (status.state == JOB_RUNNING) {
+        if (!force && (status.progress == job->last_progress ||
+                       now - job->last_event < job_ticks(JOB_PROGRESS_INTERVAL_US)))
+            return;
+    } else {
+        job->reported = true;
+    }
+
+    job->last_event = now;
+    job->last_progress = status.progress;
+    uartproxy_send_event(EVT_JOB, &status, sizeof(status));
+}
+
+static void job_task(void *opaque)
+{
+    UNUSED(opaque);
+
+    for (int i = 0; i < JOB_MAX; i++) {
+        struct job *job = &jobs[i];
+
+        if (job->status.state == JOB_FREE)
+            continue;
+
+        if (job->status.state == JOB_RUNNING && job->par) {
+            job->status.progress = gzip_par_progress(&job->gzip);
+            if (!gzip_par_poll(&job->gzip)) {
+                int ret = gzip_par_finish(&job->gzip);
+
+                job->status.progress = job->status.total;
+                job_finish(job, ret == TINF_OK ? job->gzip.dest_len : (u64)ret);
+            }
+        } else if (job->status.state == JOB_RUNNING && job->cpu < 0) {
+            if (job->cancel)
+                job_finish(job, 0);
+            else if (!job_is_memop(job->opcode))
+                job_finish(job, job_run_decompress(job));
+            else if (!job_memop_step(job))
+                job_finish(job, 0);
+        }
+
+        job_report(job, false);
+    }
+}
+
+void job_init(void)
+{
+    sched_add("jobs", job_task, NULL, 0, 0);
+}
+
+static struct job *job_alloc(void)
+{
+    struct job *oldest = NULL;
+
+    for (int i = 0; i < JOB_MAX; i++) {
+        struct job *job = &jobs[i];
+
+        if (job->status.state == JOB_FREE)
+            return job;
+        // Finished jobs the host never released are recycled, oldest first
+        if (job->status.state != JOB_RUNNING && job->reported &&
+            (!oldest || job->status.id < oldest->status.id))
+            oldest = job;
+    }
+
+    return oldest;
+}
+
+// Returns the job ID, or 0 if the op cannot run as a job or there is no free slot
+u32 job_submit(u64 opcode, const u64 *args)
+{
+    struct job *job;
+
+    if (!job_is_memop(opcode) && opcode != P_GZDEC && opcode != P_XZDEC && opcode != P_LZFSEDEC)
+        return 0;
+
+    job = job_alloc();
+    if (!job)
+        return 0;
+
+    memset(job, 0, sizeof(*job));
+    memcpy(job->args, args, sizeof(job->args));
+    job->opcode = opcode;
+    job->status.id = job_next_id++;
+    job->status.total = job_is_memop(opcode) ? args[2] : args[3];
+    job->status.state = JOB_RUNNING;
+    job->last_event = mrs(CNTPCT_EL0);
+
+    if (opcode == P_GZDEC) {
+        int ret = gzip_par_init(&job->gzip, (void *)args[2], args[3], (void *)args[0], args[1]);
+
+        if (ret < 0) {
+            job_finish(job, ret);
+            return job->status.id;
+        } else if (ret > 0) {
+            job->par = true;
+            job->cpu = -1;
+            job->status.total = job->gzip.dest_len;
+            gzip_par_start(&job->gzip);
+            return job->status.id;
+        }
+    }
+
+    job->cpu = offload_get_cpu();
+    if (job->cpu >= 0) {
+        sysop("dmb sy");
+        smp_call4(job->cpu, (void *)job_trampoline, (u64)job, 0, 0, 0);
+    }
+
+    return job->status.id;
+}
+
+struct job_status *job_get_status(u32 id)
+{
+    struct job *job = job_find(id);
+
+    return job ? &job->status : NULL;
+}
+
+// Returns the job state once it is no longer running or the timeout expires, -1 if unknown
+int job_wait(u32 id, u64 timeout_us)
+{
+    struct job *job = job_find(id);
+    u64 start = mrs(CNTPCT_EL0);
+
+    if (!job)
+        return -1;
+
+    while (job->status.state == JOB_RUNNING && mrs(CNTPCT_EL0) - start < job_ticks(timeout_us))
+        sched_yield();
+
+    job_report(job, true);
+    return job->status.state;
+}
+
+int job_cancel(u32 id)
+{
+    struct job *job = job_find(id);
+
+    if (!job)
+        return -1;
+
+    job->cancel = true;
+    sysop("dmb sy");
+    return 0;
+}
+
+int job_release(u32 id)
+{
+    struct job *job = job_find(id);
+
+    if (!job || job->status.state == JOB_RUNNING)
+        return -1;
+
+    job->status.state = JOB_FREE;
+    return 0;
+}
@@ -0,0 +1,33 @@
+/* SPDX-License-Identifier: MIT */
+
+#ifndef PROXY_JOB_H
+#define PROXY_JOB_H
+
+#include "types.h"
+
+enum job_state {
+    JOB_FREE = 0,
+    JOB_RUNNING,
+    JOB_DONE,
+    JOB_FAILED,
+    JOB_CANCELLED,
+};
+
+// Returned by P_JOB_STATUS, and the payload of EVT_JOB
+struct job_status {
+    u32 id;
+    u32 state;
+    u64 progress;
+    u64 total;
+    u64 retval;
+};
+
+void job_init(void);
+
+u32 job_submit(u64 opcode, const u64 *args);
+struct job_status *job_get_status(u32 id);
+int job_wait(u32 id, u64 timeout_us);
+int job_cancel(u32 id);
+int job_release(u32 id);
+
+#endif
@@ -0,0 +1,157 @@
+/* SPDX-License-Identifier: MIT */
+
+#include "sched.h"
+#include "exception.h"
+#include "iodev.h"
+#include "types.h"
+#include "utils.h"
+
+// Floor on how often sched_yield() looks at the task list at all
+#define SCHED_MIN_INTERVAL_US 50
+
+// Default background work: USB event handling and console draining
+#define SCHED_IODEV_PERIOD_US 100
+#define SCHED_IODEV_BUDGET_US 2000
+
+struct sched_task {
+    const char *name;
+    sched_task_func_t func;
+    void *opaque;
+    u64 period;
+    u64 budget;
+    u64 deadline;
+    u64 overruns;
+    volatile bool woken;
+};
+
+static struct sched_task sched_tasks[SCHED_MAX_TASKS];
+static u64 sched_ticks_per_us;
+static u64 sched_next;
+static volatile bool sched_woken;
+static bool in_sched;
+
+static inline u64 sched_now(void)
+{
+    return mrs(CNTPCT_EL0);
+}
+
+static void sched_iodev_task(void *opaque)
+{
+    UNUSED(opaque);
+
+    for (iodev_id_t id = 0; id < IODEV_MAX; id++) {
+        if (iodevs[id] && iodevs[id]->usage)
+            iodev_handle_events(id);
+    }
+}
+
+void sched_init(void)
+{
+    sched_ticks_per_us = mrs(CNTFRQ_EL0) / 1000000;
+    if (!sched_ticks_per_us)
+        sched_ticks_per_us = 24;
+
+    sched_add("iodev", sched_iodev_task, NULL, SCHED_IODEV_PERIOD_US, SCHED_IODEV_BUDGET_US);
+}
+
+int sched_add(const char *name, sched_task_func_t func, void *opaque, u32 period_us,
+              u32 budget_us)
+{
+    for (int i = 0; i < SCHED_MAX_TASKS; i++) {
+        struct sched_task *task = &sched_tasks[i];
+
+        if (task->func)
+            continue;
+
+        task->name = name;
+        task->opaque = opaque;
+        task->period = period_us * sched_ticks_per_us;
+        task->budget = budget_us * sched_ticks_per_us;
+        task->deadline = sched_now();
+        task->overruns = 0;
+        task->woken = false;
+        task->func = func;
+
+        sched_next = 0;
+        return i;
+    }
+
+    printf("sched: no free task slot for %s\n", name);
+    return -1;
+}
+
+void sched_remove(int id)
+{
+    if (id >= 0 && id < SCHED_MAX_TASKS)
+        sched_tasks[id].func = NULL;
+}
+
+// Safe from IRQ context: makes the task due at the next yield point
+void sched_wake(int id)
+{
+    if (id < 0 || id >= SCHED_MAX_TASKS)
+        return;
+
+    sched_tasks[id].woken = true;
+    sched_woken = true;
+}
+
+static void sched_run_due(bool force)
+{
+    // Tasks run unguarded, whatever exception guard the code that yielded has set up
+    enum exc_guard_t guard = exc_guard;
+    u64 now = sched_now();
+    u64 next = ~0UL;
+
+    exc_guard = GUARD_OFF;
+    sched_woken = false;
+
+    for (int i = 0; i < SCHED_MAX_TASKS; i++) {
+        struct sched_task *task = &sched_tasks[i];
+
+        if (!task->func)
+            continue;
+
+        if (force || task->woken || now >= task->deadline) {
+            u64 start = sched_now();
+
+            task->woken = false;
+            task->func(task->opaque);
+
+            now = sched_now();
+            if (task->budget && now - start > task->budget && !task->overruns++)
+                printf("sched: task %s ran for %ld us (budget %ld us)\n", task->name,
+                       (now - start) / sched_ticks_per_us, task->budget / sched_ticks_per_us);
+            task->deadline = now + task->period;
+        }
+
+        next = min(next, task->deadline);
+    }
+
+    sched_next = max(next, now + SCHED_MIN_INTERVAL_US * sched_ticks_per_us);
+    exc_guard = guard;
+}
+
+void sched_yield(void)
+{
+    if (!sched_ticks_per_us || in_sched || !is_primary_core())
+        return;
+
+    if (!sched_woken && sched_now() < sched_next)
+        return;
+
+    in_sched = true;
+    sched_run_due(false);
+    in_sched = false;
+}
+
+// Run every task now, regardless of deadlines (for idle loops that are waiting on I/O)
+void sched_run(void)
+{
+    if (!sched_ticks_per_us || in_sched || !is_primary_core())
+        return;
+
+    in_sched = true;
+    sched_run_due(true);
+    in_sched = false;
+}
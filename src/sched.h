@@ -0,0 +1,28 @@
+/* SPDX-License-Identifier: MIT */
+
+#ifndef SCHED_H
+#define SCHED_H
+
+#include "types.h"
+
+/*
+ * Cooperative background tasks for the boot CPU. Tasks run from sched_yield(), which the proxy
+ * loop and long-running loops (decompressors, chunked memory ops, hypervisor exits) call
+ * periodically; it is cheap when nothing is due and does nothing on secondary CPUs or when
+ * called from inside a task.
+ */
+typedef void (*sched_task_func_t)(void *opaque);
+
+#define SCHED_MAX_TASKS 16
+
+void sched_init(void);
+
+int sched_add(const char *name, sched_task_func_t func, void *opaque, u32 period_us,
+              u32 budget_us);
+void sched_remove(int id);
+void sched_wake(int id);
+
+void sched_yield(void);
+void sched_run(void);
+
+#endif
@@ -0,0 +1,110 @@
+/* SPDX-License-Identifier: MIT */
+
+#include "simd.h"
+#include "types.h"
+#include "utils.h"
+
+// Below this, saving and restoring the FP/SIMD registers costs more than the kernel saves
+#define SIMD_MIN_SIZE 1024
+
+#define ID_AA64PFR0_FP      GENMASK(19, 16)
+#define ID_AA64PFR0_ADVSIMD GENMASK(23, 20)
+
+static bool simd_usable;
+
+void simd_init(void)
+{
+    u64 pfr0 = mrs(ID_AA64PFR0_EL1);
+
+    simd_usable = FIELD_GET(ID_AA64PFR0_FP, pfr0) != 0xf &&
+                  FIELD_GET(ID_AA64PFR0_ADVSIMD, pfr0) != 0xf;
+
+    printf("SIMD: FP/SIMD kernels %s\n", simd_usable ? "enabled" : "unavailable");
+}
+
+u32 simd_checksum_copy(void *dst, const void *src, size_t length, u32 sum)
+{
+    u8 *d = dst;
+    const u8 *s = src;
+
+    if (simd_usable && length >= SIMD_MIN_SIZE && ((u64)d & 15) == ((u64)s & 15)) {
+        struct simd_state state;
+        size_t blocks;
+
+        while ((u64)s & 15) {
+            u8 b = *s++;
+            *d++ = b;
+            sum = sum * 31337 + (b ^ 0x5A);
+            length--;
+        }
+
+        blocks = length / 64;
+        simd_begin(&state);
+        sum = simd_k_checksum_copy(d, s, blocks, sum);
+        simd_end(&state);
+
+        d += blocks * 64;
+        s += blocks * 64;
+        length -= blocks * 64;
+    }
+
+    while (length--) {
+        u8 b = *s++;
+        *d++ = b;
+        sum = sum * 31337 + (b ^ 0x5A);
+    }
+
+    return sum;
+}
+
+/*
+ * The rectangle helpers return false when the vector path is not usable, and the caller falls
+ * back to its own scalar loop. Strides are in bytes for copies and in pixels otherwise.
+ */
+bool simd_copy_rect(void *dst, size_t dst_stride, const void *src, size_t src_stride,
+                    size_t width, size_t rows)
+{
+    struct simd_state state;
+
+    if (!simd_usable || width * rows < SIMD_MIN_SIZE)
+        return false;
+
+    simd_begin(&state);
+    for (size_t i = 0; i < rows; i++)
+        simd_k_copy((u8 *)dst + i * dst_stride, (const u8 *)src + i * src_stride, width);
+    simd_end(&state);
+
+    return true;
+}
+
+bool simd_rgba_to_fb30(u32 *dst, size_t dst_stride, const u32 *src, size_t src_stride, u32 w,
+                       u32 h)
+{
+    struct simd_state state;
+
+    if (!simd_usable || w * h * 4 < SIMD_MIN_SIZE || ((u64)src & 3))
+        return false;
+
+    simd_begin(&state);
+    for (u32 i = 0; i < h; i++)
+        simd_k_rgba_to_fb30(dst + i * dst_stride, src + i * src_stride, w);
+    simd_end(&state);
+
+    return true;
+}
+
+bool simd_fb30_to_rgba(u32 *dst, size_t dst_stride, const u32 *src, size_t src_stride, u32 w,
+                       u32 h)
+{
+    struct simd_state state;
+
+    if (!simd_usable || w * h * 4 < SIMD_MIN_SIZE || ((u64)dst & 3))
+        return false;
+
+    simd_begin(&state);
+    for (u32 i = 0; i < h; i++)
+        simd_k_fb30_to_rgba(dst + i * dst_stride, src + i * src_stride, w);
+    simd_end(&state);
+
+    return true;
+}
@@ -0,0 +1,43 @@
+/* SPDX-License-Identifier: MIT */
+
+#ifndef SIMD_H
+#define SIMD_H
+
+#include "types.h"
+
+/*
+ * m1n1 is built with -mgeneral-regs-only, so FP/SIMD registers are never live in m1n1 code
+ * but may hold hypervisor guest state. Vector code only runs inside a SIMD section, between
+ * simd_begin() and simd_end(): these enable FP access and save/restore the whole FP/SIMD
+ * register file (and CPACR) in the caller's state, so a section is transparent to whatever it
+ * interrupted, including another section in an exception handler.
+ */
+struct simd_state {
+    u64 q[64];
+    u64 fpsr;
+    u64 fpcr;
+    u64 cpacr;
+    u64 _pad;
+} __attribute__((aligned(16)));
+
+void simd_begin(struct simd_state *state);
+void simd_end(struct simd_state *state);
+
+void simd_init(void);
+
+/* Dispatchers, safe to call from anywhere. Large enough buffers go to the vector kernels. */
+u32 simd_checksum_copy(void *dst, const void *src, size_t length, u32 sum);
+bool simd_copy_rect(void *dst, size_t dst_stride, const void *src, size_t src_stride,
+                    size_t width, size_t rows);
+bool simd_rgba_to_fb30(u32 *dst, size_t dst_stride, const u32 *src, size_t src_stride, u32 w,
+                       u32 h);
+bool simd_fb30_to_rgba(u32 *dst, size_t dst_stride, const u32 *src, size_t src_stride, u32 w,
+                       u32 h);
+
+/* Vector kernels (simd_kernels.c), only to be called inside a SIMD section */
+u32 simd_k_checksum_copy(void *dst, const void *src, size_t blocks, u32 sum);
+void simd_k_copy(void *dst, const void *src, size_t length);
+void simd_k_rgba_to_fb30(u32 *dst, const u32 *src, u32 count);
+void simd_k_fb30_to_rgba(u32 *dst, const u32 *src, u32 count);
+
+#endif
@@ -0,0 +1,159 @@
+/* SPDX-License-Identifier: MIT */
+
+/*
+ * This file is built with FP/SIMD allowed (see the Makefile), and everything in it must only
+ * be called inside a SIMD section. The kernels use GCC vector extensions, which map straight
+ * onto NEON here and can be built for the host to check them against the scalar code.
+ */
+
+#include "simd.h"
+#include "types.h"
+
+typedef u32 u32x4 __attribute__((vector_size(16)));
+
+#define CHECKSUM_MUL     31337
+#define CHECKSUM_MUL_64  0x83c9d201 // CHECKSUM_MUL ** 64
+#define CHECKSUM_XOR_X4  0x5a5a5a5a
+
+/*
+ * Weight of byte 16j + 4l + k of a 64-byte block in the uartproxy checksum is
+ * CHECKSUM_MUL ** (63 - (16j + 4l + k)); vector 4j + k holds that for lanes l = 0..3.
+ */
+static const u32x4 checksum_weights[16] = {
+    {0x46b9b7d9, 0x7621d9b9, 0xcb931f99, 0xdb1d0979},
+    {0x8ab543f1, 0x4c6d5ad1, 0xf258f5b1, 0xf31b9491},
+    {0xc11bfc49, 0x2cd3c029, 0x248a6809, 0xd25773e9},
+    {0x95a476e1, 0x9c66dfc1, 0xb56c8ca1, 0x2c20fd81},
+    {0x945f1759, 0xa088c939, 0x00599f19, 0xea2118f9},
+    {0x3268b771, 0xaf03de51, 0x70c08931, 0xb6823811},
+    {0x22e263c9, 0x4362b7a9, 0x5f9fef89, 0x9ff18b69},
+    {0x07ffb261, 0xda942b41, 0xcd79e821, 0xf05c6901},
+    {0xe7beb6d9, 0x34a1f8b9, 0x5bca5e99, 0x15c76879},
+    {0x643c6af1, 0xb0f2a1d1, 0x14b85cb1, 0x76b11b91},
+    {0x673f0b49, 0xd0ffef29, 0x6f3bb709, 0x4889e2e9},
+    {0xc6f72de1, 0x1715b6c1, 0xf69383a1, 0x195c1481},
+    {0x66b89659, 0xfc4d6839, 0xcbc55e19, 0xefeff7f9},
+    {0x9b105e71, 0xd119a551, 0xe1207031, 0x3a883f11},
+    {0x1611f2c9, 0xc18b66a9, 0x233dbe89, 0x00007a69},
+    {0x5f6ae961, 0xa2cb8241, 0xc5995f21, 0x00000001},
+};
+
+/*
+ * The checksum is sum = sum * MUL + (byte ^ 0x5a) per byte, so over a 64-byte block it is
+ * sum * MUL^64 plus a weighted sum of the block, which vectorizes. src and dst (if not NULL)
+ * must be 16-byte aligned.
+ */
+u32 simd_k_checksum_copy(void *dst, const void *src, size_t blocks, u32 sum)
+{
+    const u32x4 *s = src;
+    u32x4 *d = dst;
+    u32x4 acc = {0, 0, 0, 0};
+    u32 scale = 1;
+
+    while (blocks--) {
+        u32x4 block = {0, 0, 0, 0};
+
+        for (int j = 0; j < 4; j++) {
+            u32x4 v = s[j];
+
+            if (d)
+                d[j] = v;
+            v ^= CHECKSUM_XOR_X4;
+            for (int k = 0; k < 4; k++)
+                block += ((v >> (8 * k)) & 0xff) * checksum_weights[4 * j + k];
+        }
+
+        acc = acc * CHECKSUM_MUL_64 + block;
+        scale *= CHECKSUM_MUL_64;
+        s += 4;
+        if (d)
+            d += 4;
+    }
+
+    return sum * scale + acc[0] + acc[1] + acc[2] + acc[3];
+}
+
+void simd_k_copy(void *dst, const void *src, size_t length)
+{
+    u8 *d = dst;
+    const u8 *s = src;
+
+    while (length && ((u64)d & 15)) {
+        *d++ = *s++;
+        length--;
+    }
+
+    if (!((u64)s & 15)) {
+        for (; length >= 64; length -= 64) {
+            u32x4 a = ((const u32x4 *)s)[0];
+            u32x4 b = ((const u32x4 *)s)[1];
+            u32x4 c = ((const u32x4 *)s)[2];
+            u32x4 e = ((const u32x4 *)s)[3];
+            ((u32x4 *)d)[0] = a;
+            ((u32x4 *)d)[1] = b;
+            ((u32x4 *)d)[2] = c;
+            ((u32x4 *)d)[3] = e;
+            s += 64;
+            d += 64;
+        }
+        for (; length >= 16; length -= 16) {
+            *(u32x4 *)d = *(const u32x4 *)s;
+            s += 16;
+            d += 16;
+        }
+    }
+
+    while (length--)
+        *d++ = *s++;
+}
+
+static inline u32x4 load_u32x4(const u32 *p)
+{
+    if (!((u64)p & 15))
+        return *(const u32x4 *)p;
+
+    return (u32x4){p[0], p[1], p[2], p[3]};
+}
+
+// Same conversions as rgb2pixel_30 / pixel2rgb_30 in fb.c
+static inline u32x4 rgba_to_fb30(u32x4 p)
+{
+    return ((p & 0xff) << 22) | (((p >> 8) & 0xff) << 12) | (((p >> 16) & 0xff) << 2);
+}
+
+static inline u32x4 fb30_to_rgba(u32x4 p)
+{
+    return ((p >> 22) & 0xff) | (((p >> 12) & 0xff) << 8) | (((p >> 2) & 0xff) << 16) |
+           0xff000000;
+}
+
+// dst and src are 32-bit aligned; dst is brought to 16-byte alignment, src may stay unaligned
+void simd_k_rgba_to_fb30(u32 *dst, const u32 *src, u32 count)
+{
+    for (; count && ((u64)dst & 15); count--)
+        *dst++ = rgba_to_fb30((u32x4){*src++, 0, 0, 0})[0];
+
+    for (; count >= 4; count -= 4) {
+        *(u32x4 *)dst = rgba_to_fb30(load_u32x4(src));
+        dst += 4;
+        src += 4;
+    }
+
+    for (; count; count--)
+        *dst++ = rgba_to_fb30((u32x4){*src++, 0, 0, 0})[0];
+}
+
+void simd_k_fb30_to_rgba(u32 *dst, const u32 *src, u32 count)
+{
+    for (; count && ((u64)dst & 15); count--)
+        *dst++ = fb30_to_rgba((u32x4){*src++, 0, 0, 0})[0];
+
+    for (; count >= 4; count -= 4) {
+        *(u32x4 *)dst = fb30_to_rgba(load_u32x4(src));
+        dst += 4;
+        src += 4;
+    }
+
+    for (; count; count--)
+        *dst++ = fb30_to_rgba((u32x4){*src++, 0, 0, 0})[0];
+}
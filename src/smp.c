@@ -2,6 +2,7 @@
 
 #include "smp.h"
 #include "adt.h"
+#include "aic.h"
 #include "string.h"
 #include "types.h"
 #include "utils.h"
@@ -34,6 +35,8 @@ void smp_secondary_entry(void)
 
     me->mpidr = mrs(MPIDR_EL1) & 0xFFFFFF;
 
+    aic_init_cpu();
+
     sysop("dmb sy");
     me->flag = 1;
     sysop("dmb sy");
@@ -184,6 +187,12 @@ u64 smp_wait(int cpu)
     return target->retval;
 }
 
+bool smp_is_busy(int cpu)
+{
+    sysop("dmb ld");
+    return spin_table[cpu].target;
+}
+
 bool smp_is_alive(int cpu)
 {
     return spin_table[cpu].flag;
@@ -194,6 +203,22 @@ int smp_get_mpidr(int cpu)
     return spin_table[cpu].mpidr;
 }
 
+// Index of the calling CPU in the spin table, 0 for the boot CPU
+int smp_id(void)
+{
+    if (is_primary_core())
+        return 0;
+
+    u64 mpidr = mrs(MPIDR_EL1) & 0xFFFFFF;
+
+    for (int i = 1; i < MAX_CPUS; i++) {
+        if (spin_table[i].flag && spin_table[i].mpidr == mpidr)
+            return i;
+    }
+
+    return 0;
+}
+
 u64 smp_get_release_addr(int cpu)
 {
     struct spin_table *target = &spin_table[cpu];
@@ -20,8 +20,10 @@ void smp_call4(int cpu, void *func, u64 arg0, u64 arg1, u64 arg2, u64 arg3);
 
 u64 smp_wait(int cpu);
 
+bool smp_is_busy(int cpu);
 bool smp_is_alive(int cpu);
 int smp_get_mpidr(int cpu);
+int smp_id(void);
 u64 smp_get_release_addr(int cpu);
 
 #endif
@@ -26,6 +26,7 @@
  */
 
 #include "tinf.h"
+#include "../sched.h"
 
 #include <assert.h>
 #include <limits.h>
@@ -580,6 +581,9 @@ int tinf_uncompress(void *dest, unsigned int *destLen,
 		unsigned int btype;
 		int res;
 
+		/* Let m1n1 background tasks run between blocks */
+		sched_yield();
+
 		/* Read final block flag */
 		bfinal = tinf_getbits(&d, 1);
 
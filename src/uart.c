@@ -3,7 +3,10 @@
 #include <stdarg.h>
 
 #include "uart.h"
+#include "adt.h"
+#include "aic.h"
 #include "iodev.h"
+#include "ringbuffer.h"
 #include "types.h"
 #include "uart_regs.h"
 #include "utils.h"
@@ -13,6 +16,10 @@
 
 #define UART_BASE 0x235200000L
 
+#define UART_RXBUF_SIZE 0x10000
+
+#define DAIF_I BIT(7)
+
 void *pxx = uart_init;
 
 void uart_init(void)
@@ -28,8 +35,142 @@ void uart_putbyte(u8 c)
     write32(UART_BASE + UTXH, c);
 }
 
+/*
+ * With the RX interrupt enabled, received bytes are moved from the FIFO into uart_rxbuf as soon
+ * as they arrive, and readers consume them from there. The ring buffer is only touched with
+ * IRQs masked. If it fills up, the RX interrupt is turned off and the bytes stay in the FIFO
+ * until the reader catches up.
+ */
+static ringbuffer_t *uart_rxbuf;
+static u32 uart_irq;
+static u32 uart_ucon_saved;
+static bool uart_irq_enabled;
+static bool uart_rx_throttled;
+
+static void uart_rx_drain(void)
+{
+    while (!uart_rx_throttled && (read32(UART_BASE + UTRSTAT) & UTRSTAT_RXD)) {
+        if (ringbuffer_get_free(uart_rxbuf) <= 1) {
+            if (uart_irq_enabled)
+                clear32(UART_BASE + UCON, UCON_RXTHRESH_ENA | UCON_RXTO_ENA);
+            uart_rx_throttled = true;
+            break;
+        }
+
+        u8 c = read32(UART_BASE + URXH);
+        ringbuffer_write(&c, 1, uart_rxbuf);
+    }
+}
+
+static void uart_irq_handler(void *opaque, u32 irq)
+{
+    UNUSED(opaque);
+    UNUSED(irq);
+
+    write32(UART_BASE + UTRSTAT, UTRSTAT_RXTHRESH | UTRSTAT_RXTO);
+    uart_rx_drain();
+}
+
+static size_t uart_rx_pull(u8 *buf, size_t count)
+{
+    u64 daif = mrs(DAIF);
+    size_t got;
+
+    msr(DAIF, daif | DAIF_I);
+
+    uart_rx_drain();
+    got = ringbuffer_read(buf, count, uart_rxbuf);
+
+    if (uart_rx_throttled && ringbuffer_get_free(uart_rxbuf) > UART_RXBUF_SIZE / 2) {
+        uart_rx_throttled = false;
+        if (uart_irq_enabled)
+            set32(UART_BASE + UCON, UCON_RXTHRESH_ENA | UCON_RXTO_ENA);
+        uart_rx_drain();
+    }
+
+    msr(DAIF, daif);
+
+    return got;
+}
+
+static bool uart_try_getbyte(u8 *c)
+{
+    if (uart_rxbuf)
+        return uart_rx_pull(c, 1);
+
+    if (!(read32(UART_BASE + UTRSTAT) & UTRSTAT_RXD))
+        return false;
+
+    *c = read32(UART_BASE + URXH);
+    return true;
+}
+
+int uart_irq_init(void)
+{
+    int path[8];
+    int node = adt_path_offset_trace(adt, "/arm-io/uart0", path);
+
+    if (!aic_is_initialized())
+        return -1;
+
+    if (node < 0) {
+        printf("UART: Error getting /arm-io/uart0 node\n");
+        return -1;
+    }
+
+    if (ADT_GETPROP(adt, node, "interrupts", &uart_irq) < 0) {
+        printf("UART: Error getting uart0 interrupts\n");
+        return -1;
+    }
+
+    if (!uart_rxbuf)
+        uart_rxbuf = ringbuffer_alloc(UART_RXBUF_SIZE);
+    if (!uart_rxbuf) {
+        printf("UART: Failed to allocate RX buffer\n");
+        return -1;
+    }
+
+    uart_ucon_saved = read32(UART_BASE + UCON);
+    if (aic_set_handler(uart_irq, uart_irq_handler, NULL) < 0) {
+        printf("UART: Failed to register IRQ %d\n", uart_irq);
+        return -1;
+    }
+
+    uart_irq_enabled = true;
+    write32(UART_BASE + UTRSTAT, UTRSTAT_RXTHRESH | UTRSTAT_RXTO);
+    if (!uart_rx_throttled)
+        set32(UART_BASE + UCON, UCON_RXTHRESH_ENA | UCON_RXTO_ENA);
+
+    printf("UART: RX interrupt %d enabled\n", uart_irq);
+
+    return 0;
+}
+
+/*
+ * Bytes already in the ring buffer are still handed out by the read functions afterwards; they
+ * just go back to polling the FIFO once it is empty.
+ */
+void uart_irq_shutdown(void)
+{
+    if (!uart_irq_enabled)
+        return;
+
+    aic_set_handler(uart_irq, NULL, NULL);
+    write32(UART_BASE + UCON, uart_ucon_saved);
+    write32(UART_BASE + UTRSTAT, UTRSTAT_RXTHRESH | UTRSTAT_RXTO);
+    uart_irq_enabled = false;
+}
+
 u8 uart_getbyte(void)
 {
+    u8 c;
+
+    if (uart_rxbuf) {
+        while (!uart_rx_pull(&c, 1))
+            ;
+        return c;
+    }
+
     while (!(read32(UART_BASE + UTRSTAT) & 0x01))
         ;
 
@@ -70,6 +211,12 @@ size_t uart_read(void *buf, size_t count)
     u8 *p = buf;
     size_t recvd = 0;
 
+    if (uart_rxbuf) {
+        while (recvd < count)
+            recvd += uart_rx_pull(p + recvd, count - recvd);
+        return recvd;
+    }
+
     while (count--) {
         *p++ = uart_getbyte();
         recvd++;
@@ -84,12 +231,38 @@ void uart_setbaud(int baudrate)
     write32(UART_BASE + UBRDIV, ((UART_CLOCK / baudrate + 7) / 16) - 1);
 }
 
+int uart_getbaud(void)
+{
+    return UART_CLOCK / (16 * (read32(UART_BASE + UBRDIV) + 1));
+}
+
 void uart_flush(void)
 {
     while (!(read32(UART_BASE + UTRSTAT) & 0x04))
         ;
 }
 
+/*
+ * Wait for a little-endian 32-bit word to arrive, skipping anything received before it.
+ * Used to check that the host can still talk to us after a baud rate change.
+ */
+bool uart_wait_word(u32 word, u32 timeout_us)
+{
+    u32 window = 0;
+    u8 c;
+
+    while (timeout_us--) {
+        while (uart_try_getbyte(&c)) {
+            window = (window >> 8) | ((u32)c << 24);
+            if (window == word)
+                return true;
+        }
+        udelay(1);
+    }
+
+    return false;
+}
+
 static bool uart_iodev_can_write(void *opaque)
 {
     UNUSED(opaque);
@@ -99,7 +272,11 @@ static bool uart_iodev_can_write(void *opaque)
 static bool uart_iodev_can_read(void *opaque)
 {
     UNUSED(opaque);
-    return read32(UART_BASE + UTRSTAT) & 0x01;
+
+    if (uart_rxbuf && ringbuffer_get_used(uart_rxbuf))
+        return true;
+
+    return read32(UART_BASE + UTRSTAT) & UTRSTAT_RXD;
 }
 
 static ssize_t uart_iodev_read(void *opaque, void *buf, size_t len)
@@ -115,11 +292,25 @@ static ssize_t uart_iodev_write(void *opaque, const void *buf, size_t len)
     return len;
 }
 
+static ssize_t uart_iodev_writev(void *opaque, const struct iodev_iovec *iov, int iovcnt)
+{
+    ssize_t total = 0;
+
+    UNUSED(opaque);
+    for (int i = 0; i < iovcnt; i++) {
+        uart_write(iov[i].base, iov[i].len);
+        total += iov[i].len;
+    }
+
+    return total;
+}
+
 static struct iodev_ops iodev_uart_ops = {
     .can_read = uart_iodev_can_read,
     .can_write = uart_iodev_can_write,
     .read = uart_iodev_read,
     .write = uart_iodev_write,
+    .writev = uart_iodev_writev,
 };
 
 struct iodev iodev_uart = {
@@ -6,6 +6,8 @@
 #include "types.h"
 
 void uart_init(void);
+int uart_irq_init(void);
+void uart_irq_shutdown(void);
 
 void uart_putbyte(u8 c);
 u8 uart_getbyte(void);
@@ -19,6 +21,8 @@ size_t uart_read(void *buf, size_t count);
 void uart_puts(const char *s);
 
 void uart_setbaud(int baudrate);
+int uart_getbaud(void);
+bool uart_wait_word(u32 word, u32 timeout_us);
 
 void uart_flush(void);
 
@@ -8,3 +8,10 @@
 #define URXH     0x024
 #define UBRDIV   0x028
 #define UFRACVAL 0x02c
+
+#define UCON_RXTO_ENA     BIT(9)
+#define UCON_RXTHRESH_ENA BIT(12)
+
+#define UTRSTAT_RXD      BIT(0)
+#define UTRSTAT_RXTHRESH BIT(4)
+#define UTRSTAT_RXTO     BIT(9)
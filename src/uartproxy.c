@@ -4,7 +4,10 @@
 #include "assert.h"
 #include "exception.h"
 #include "iodev.h"
+#include "memory.h"
 #include "proxy.h"
+#include "sched.h"
+#include "simd.h"
 #include "string.h"
 #include "types.h"
 #include "utils.h"
@@ -82,6 +85,51 @@ static u32 __attribute__((noinline)) checksum_block(void *start, u32 length, u32
     return sum;
 }
 
+/*
+ * Copy a block while folding it into the checksum, so each byte is only touched once. If wide
+ * is set, works a word at a time once src is aligned (callers keep dst at the same alignment);
+ * otherwise both sides are accessed a byte at a time, which is what device ranges expect. Same
+ * no-stack / GUARD_RETURN contract as checksum_block.
+ */
+static u32 __attribute__((noinline))
+checksum_copy(void *dst, const void *src, u32 length, u32 init, bool wide)
+{
+    u32 sum = init;
+    u8 *d = dst;
+    const u8 *s = src;
+
+    while (wide && length && ((u64)s & 7)) {
+        u8 b = *s++;
+        *d++ = b;
+        sum *= 31337;
+        sum += b ^ 0x5A;
+        length--;
+    }
+
+    if (wide && !((u64)d & 7)) {
+        for (; length >= 8; length -= 8) {
+            u64 w = *(const u64 *)s;
+            *(u64 *)d = w;
+            for (int i = 0; i < 8; i++) {
+                sum *= 31337;
+                sum += (w & 0xff) ^ 0x5A;
+                w >>= 8;
+            }
+            s += 8;
+            d += 8;
+        }
+    }
+
+    while (length--) {
+        u8 b = *s++;
+        *d++ = b;
+        sum *= 31337;
+        sum += b ^ 0x5A;
+    }
+
+    return sum;
+}
+
 static inline u32 checksum_start(void *start, u32 length)
 {
     return checksum_block(start, length, CHECKSUM_INIT);
@@ -104,12 +152,90 @@ static inline u32 checksum(void *start, u32 length)
 
 iodev_id_t uartproxy_iodev;
 
-int uartproxy_run(struct uartproxy_msg_start *start)
+#define XFER_CHUNK 0x4000
+
+// Bounce buffer for memory transfers, with slack to match the alignment of the target range
+static u8 xfer_buf[XFER_CHUNK + 16] __attribute__((aligned(64)));
+
+/*
+ * MEMREAD data goes out through the bounce buffer and is checksummed on the way, so the
+ * source (which may be a read-sensitive device range) is only read once, and only read wider
+ * than a byte if it is RAM. Since the checksum and any fault are only known at the end, they
+ * follow the data in a trailer.
+ */
+static void uartproxy_memread(iodev_id_t iodev, u64 addr, u64 size)
+{
+    struct {
+        u32 dchecksum;
+        s32 status;
+    } trailer = {0, ST_OK};
+    u32 sum = CHECKSUM_INIT;
+    u8 *buf = &xfer_buf[addr & 15];
+
+    while (size) {
+        u32 block = min(size, XFER_CHUNK);
+
+        if (trailer.status == ST_OK) {
+            bool wide = mmu_is_normal(addr, block);
+
+            exc_count = 0;
+            exc_guard = GUARD_RETURN;
+            sum = checksum_copy(buf, (void *)addr, block, sum, wide);
+            exc_guard = GUARD_OFF;
+            if (exc_count)
+                trailer.status = ST_XFRERR;
+        }
+        // Keep the framing intact after a fault
+        if (trailer.status != ST_OK)
+            memset(buf, 0, block);
+
+        iodev_queue(iodev, buf, block);
+        addr += block;
+        size -= block;
+    }
+
+    trailer.dchecksum = checksum_finish(sum);
+    iodev_write(iodev, &trailer, sizeof(trailer));
+}
+
+/*
+ * MEMWRITE data is staged in the bounce buffer and checksummed as it is copied into place. Only
+ * RAM gets the vector copy; anything else is written a byte at a time.
+ */
+static int uartproxy_memwrite(iodev_id_t iodev, u64 addr, u64 size, u32 *dchecksum)
+{
+    u32 sum = CHECKSUM_INIT;
+    u8 *buf = &xfer_buf[addr & 15];
+
+    while (size) {
+        u32 block = min(size, XFER_CHUNK);
+
+        if (iodev_read(iodev, buf, block) != block)
+            return -1;
+        if (mmu_is_normal(addr, block))
+            sum = simd_checksum_copy((void *)addr, buf, block, sum);
+        else
+            sum = checksum_copy((void *)addr, buf, block, sum, false);
+        addr += block;
+        size -= block;
+    }
+
+    *dchecksum = checksum_finish(sum);
+    return 0;
+}
+
+/*
+ * If data is given, it is sent inline right after the start message (followed by its own
+ * checksum), and start->inline_len tells the host how much to expect. If the host ends the
+ * session with P_EXIT, its second argument is returned in *exit_data.
+ */
+static int uartproxy_session(struct uartproxy_msg_start *start, void *data, u16 length,
+                             u64 *exit_data)
 {
     int ret;
     int running = 1;
     size_t bytes;
-    u64 checksum_val;
+    u32 checksum_val;
 
     iodev_id_t iodev = IODEV_MAX;
 
@@ -123,8 +249,19 @@ int uartproxy_run(struct uartproxy_msg_start *start)
         // Exceptions / hooks keep the current iodev
         iodev = uartproxy_iodev;
         reply.start = *start;
+        reply.start.inline_len = data ? length : 0;
         reply.checksum = checksum(&reply, REPLY_SIZE - 4);
-        iodev_write(iodev, &reply, REPLY_SIZE);
+        if (data) {
+            u32 csum = checksum(data, length);
+            struct iodev_iovec iov[] = {
+                {&reply, REPLY_SIZE},
+                {data, length},
+                {&csum, sizeof(csum)},
+            };
+            iodev_writev(iodev, iov, sizeof(iov) / sizeof(*iov));
+        } else {
+            iodev_write(iodev, &reply, REPLY_SIZE);
+        }
     }
 
     while (running) {
@@ -132,6 +269,7 @@ int uartproxy_run(struct uartproxy_msg_start *start)
             // Look for commands from any iodev on startup
             for (iodev = 0; iodev < IODEV_MAX;) {
                 u8 b;
+                sched_yield();
                 iodev_handle_events(iodev);
                 if (iodev_can_read(iodev) && iodev_read(iodev, &b, 1) == 1) {
                     iodev_proxy_buffer[iodev] >>= 8;
@@ -183,21 +321,16 @@ int uartproxy_run(struct uartproxy_msg_start *start)
                 break;
             case REQ_PROXY:
                 ret = proxy_process(&request.prequest, &reply.preply);
-                if (ret != 0)
+                if (ret != 0) {
                     running = 0;
+                    if (exit_data)
+                        *exit_data = reply.preply.retval;
+                }
                 if (ret < 0)
                     printf("Proxy req error: %d\n", ret);
                 break;
             case REQ_MEMREAD:
-                if (request.mrequest.size == 0)
-                    break;
-                exc_count = 0;
-                exc_guard = GUARD_RETURN;
-                checksum_val = checksum((void *)request.mrequest.addr, request.mrequest.size);
-                exc_guard = GUARD_OFF;
-                if (exc_count)
-                    reply.status = ST_XFRERR;
-                reply.mreply.dchecksum = checksum_val;
+                // Data and trailer are sent by uartproxy_memread() after the reply
                 break;
             case REQ_MEMWRITE:
                 exc_count = 0;
@@ -213,12 +346,11 @@ int uartproxy_run(struct uartproxy_msg_start *start)
                     reply.status = ST_XFRERR;
                     break;
                 }
-                bytes = iodev_read(iodev, (void *)request.mrequest.addr, request.mrequest.size);
-                if (bytes != request.mrequest.size) {
+                if (uartproxy_memwrite(iodev, request.mrequest.addr, request.mrequest.size,
+                                       &checksum_val) < 0) {
                     reply.status = ST_XFRERR;
                     break;
                 }
-                checksum_val = checksum((void *)request.mrequest.addr, request.mrequest.size);
                 reply.mreply.dchecksum = checksum_val;
                 if (reply.mreply.dchecksum != request.mrequest.dchecksum)
                     reply.status = ST_XFRERR;
@@ -228,16 +360,29 @@ int uartproxy_run(struct uartproxy_msg_start *start)
                 break;
         }
         reply.checksum = checksum(&reply, REPLY_SIZE - 4);
-        iodev_write(iodev, &reply, REPLY_SIZE);
 
-        if ((request.type == REQ_MEMREAD) && (reply.status == ST_OK)) {
-            iodev_write(iodev, (void *)request.mrequest.addr, request.mrequest.size);
+        if ((request.type == REQ_MEMREAD) && request.mrequest.size) {
+            iodev_queue(iodev, &reply, REPLY_SIZE);
+            uartproxy_memread(iodev, request.mrequest.addr, request.mrequest.size);
+        } else {
+            iodev_write(iodev, &reply, REPLY_SIZE);
         }
     }
 
     return ret;
 }
 
+int uartproxy_run(struct uartproxy_msg_start *start)
+{
+    return uartproxy_session(start, NULL, 0, NULL);
+}
+
+int uartproxy_run_inline(struct uartproxy_msg_start *start, void *data, u16 length,
+                         u64 *exit_data)
+{
+    return uartproxy_session(start, data, length, exit_data);
+}
+
 void uartproxy_send_event(u16 event_type, void *data, u16 length)
 {
     UartEventHdr hdr;
@@ -249,7 +394,11 @@ void uartproxy_send_event(u16 event_type, void *data, u16 length)
 
     csum = checksum_start(&hdr, sizeof(UartEventHdr));
     csum = checksum_finish(checksum_add(data, length, csum));
-    iodev_queue(uartproxy_iodev, &hdr, sizeof(UartEventHdr));
-    iodev_queue(uartproxy_iodev, data, length);
-    iodev_write(uartproxy_iodev, &csum, sizeof(csum));
+
+    struct iodev_iovec iov[] = {
+        {&hdr, sizeof(UartEventHdr)},
+        {data, length},
+        {&csum, sizeof(csum)},
+    };
+    iodev_writev(uartproxy_iodev, iov, sizeof(iov) / sizeof(*iov));
 }
@@ -30,6 +30,9 @@ typedef enum _uartproxy_exc_ret_t {
 
 typedef enum _uartproxy_event_type_t {
     EVT_MMIOTRACE = 1,
+    EVT_PVCON = 2,
+    EVT_MMIOTRACE_DELTA = 3,
+    EVT_JOB = 4,
 } uartproxy_event_type_t;
 
 struct uartproxy_exc_info {
@@ -44,16 +47,19 @@ struct uartproxy_exc_info {
     u64 far_phys;
     u64 sp_phys;
     void *extra;
+    u64 time; // CNTPCT_EL0 at exception entry
 };
 
 struct uartproxy_msg_start {
     u32 reason;
     u32 code;
     void *info;
-    void *reserved;
+    u64 inline_len;
 };
 
 int uartproxy_run(struct uartproxy_msg_start *start);
+int uartproxy_run_inline(struct uartproxy_msg_start *start, void *data, u16 length,
+                         u64 *exit_data);
 void uartproxy_send_event(u16 event_type, void *data, u16 length);
 
 #endif
@@ -175,6 +175,11 @@ dwc3_dev_t *usb_bringup(u32 idx)
         return usb_dwc3_queue(dev, pipe, buf, count);                                              \
     }                                                                                              \
                                                                                                    \
+    static ssize_t usb_##name##_writev(void *dev, const struct iodev_iovec *iov, int iovcnt)       \
+    {                                                                                              \
+        return usb_dwc3_writev(dev, pipe, iov, iovcnt);                                            \
+    }                                                                                              \
+                                                                                                   \
     static void usb_##name##_handle_events(void *dev)                                              \
     {                                                                                              \
         usb_dwc3_handle_events(dev);                                                               \
@@ -194,6 +199,7 @@ static struct iodev_ops iodev_usb_ops = {
     .read = usb_0_read,
     .write = usb_0_write,
     .queue = usb_0_queue,
+    .writev = usb_0_writev,
     .flush = usb_0_flush,
     .handle_events = usb_0_handle_events,
 };
@@ -204,6 +210,7 @@ static struct iodev_ops iodev_usb_sec_ops = {
     .read = usb_1_read,
     .write = usb_1_write,
     .queue = usb_1_queue,
+    .writev = usb_1_writev,
     .flush = usb_1_flush,
     .handle_events = usb_1_handle_events,
 };
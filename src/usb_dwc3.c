@@ -1313,6 +1313,21 @@ size_t usb_dwc3_write(dwc3_dev_t *dev, cdc_acm_pipe_id_t pipe, const void *buf,
     return ret;
 }
 
+size_t usb_dwc3_writev(dwc3_dev_t *dev, cdc_acm_pipe_id_t pipe, const struct iodev_iovec *iov,
+                       int iovcnt)
+{
+    u8 ep = dev->pipe[pipe].ep_in;
+    size_t ret = 0;
+
+    // Gather all segments into the ring buffer so they go out in as few transfers as possible
+    for (int i = 0; i < iovcnt; i++)
+        ret += usb_dwc3_queue(dev, pipe, iov[i].base, iov[i].len);
+
+    usb_dwc3_cdc_start_bulk_in_xfer(dev, ep);
+
+    return ret;
+}
+
 size_t usb_dwc3_read(dwc3_dev_t *dev, cdc_acm_pipe_id_t pipe, void *buf, size_t count)
 {
     u8 *p = buf;
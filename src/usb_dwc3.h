@@ -4,6 +4,7 @@
 #define USB_DWC3_H
 
 #include "dart.h"
+#include "iodev.h"
 #include "types.h"
 
 typedef struct dwc3_dev dwc3_dev_t;
@@ -28,6 +29,8 @@ void usb_dwc3_putbyte(dwc3_dev_t *dev, cdc_acm_pipe_id_t pipe, u8 byte);
 size_t usb_dwc3_read(dwc3_dev_t *dev, cdc_acm_pipe_id_t pipe, void *buf, size_t count);
 size_t usb_dwc3_write(dwc3_dev_t *dev, cdc_acm_pipe_id_t pipe, const void *buf, size_t count);
 size_t usb_dwc3_queue(dwc3_dev_t *dev, cdc_acm_pipe_id_t pipe, const void *buf, size_t count);
+size_t usb_dwc3_writev(dwc3_dev_t *dev, cdc_acm_pipe_id_t pipe, const struct iodev_iovec *iov,
+                       int iovcnt);
 void usb_dwc3_flush(dwc3_dev_t *dev, cdc_acm_pipe_id_t pipe);
 
 #endif
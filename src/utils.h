@@ -345,6 +345,13 @@ void memcpy16(void *dst, void *src, size_t size);
 void memset8(void *dst, u8 value, size_t size);
 void memcpy8(void *dst, void *src, size_t size);
 
+/*
+ * Normal (cacheable) memory only, 8-byte aligned buffers, multiple of 8 bytes. Use
+ * mem_copy()/mem_fill() from memory.h to pick these when it is safe.
+ */
+void memcpy_normal(void *dst, void *src, size_t size);
+void memset64_normal(void *dst, u64 value, size_t size);
+
 void hexdump(const void *d, size_t len);
 void regdump(u64 addr, size_t len);
 int sprintf(char *str, const char *fmt, ...);
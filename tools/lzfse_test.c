@@ -0,0 +1,459 @@
+/* SPDX-License-Identifier: MIT */
+
+/*
+ * Host-side check of the LZFSE/LZVN decoder in src/lzfse.c against streams written by Apple's
+ * reference lzfse tool. Each file.lzfse given must decode back to file, with its input size
+ * known and unknown, and must fail with LZFSE_ERR_NOSPACE when decoded into anything shorter.
+ * Truncated copies must be rejected, and corrupted ones must not write past the output buffer.
+ * The reference encoder only writes v2 LZFSE headers, so every stream with v2 blocks is checked
+ * again with those headers expanded to the v1 layout. Built and run by `make host-test`.
+ */
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "lzfse.h"
+
+#define GUARD 64
+#define FILL  0xa5
+
+#define MAGIC_END  0x24787662 // "bvx$"
+#define MAGIC_RAW  0x2d787662 // "bvx-"
+#define MAGIC_V1   0x31787662 // "bvx1"
+#define MAGIC_V2   0x32787662 // "bvx2"
+#define MAGIC_LZVN 0x6e787662 // "bvxn"
+
+#define V2_HEADER_LEN 32
+#define N_FREQS       (20 + 20 + 64 + 256)
+
+enum block_type { BLOCK_V1, BLOCK_V2, BLOCK_LZVN, BLOCK_RAW, BLOCK_TYPES };
+
+static const char *const block_names[BLOCK_TYPES] = {"v1", "v2", "LZVN", "raw"};
+
+// Block header of v1 streams, as laid out by the reference implementation
+struct v1_header {
+    uint32_t magic;
+    uint32_t n_raw_bytes;
+    uint32_t n_payload_bytes;
+    uint32_t n_literals;
+    uint32_t n_matches;
+    uint32_t n_literal_payload_bytes;
+    uint32_t n_lmd_payload_bytes;
+    int32_t literal_bits;
+    uint16_t literal_state[4];
+    int32_t lmd_bits;
+    uint16_t l_state;
+    uint16_t m_state;
+    uint16_t d_state;
+    uint16_t freq[N_FREQS]; // L, M, D, then literals
+};
+
+_Static_assert(sizeof(struct v1_header) == 772, "v1 header layout");
+
+static unsigned int failures;
+static unsigned long cases;
+static unsigned long blocks[BLOCK_TYPES];
+
+static uint32_t rng_state = 0x12345678;
+
+static uint32_t rng(void)
+{
+    rng_state ^= rng_state << 13;
+    rng_state ^= rng_state >> 17;
+    rng_state ^= rng_state << 5;
+    return rng_state;
+}
+
+static uint32_t le32(const uint8_t *p)
+{
+    return p[0] | (p[1] << 8) | (p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+static uint64_t le64(const uint8_t *p)
+{
+    return le32(p) | ((uint64_t)le32(p + 4) << 32);
+}
+
+static uint64_t field(uint64_t v, int offset, int width)
+{
+    return (v >> offset) & ((1ULL << width) - 1);
+}
+
+static uint8_t *load(const char *path, size_t *size)
+{
+    FILE *f = fopen(path, "rb");
+    uint8_t *buf;
+    long len;
+
+    if (!f) {
+        perror(path);
+        return NULL;
+    }
+
+    fseek(f, 0, SEEK_END);
+    len = ftell(f);
+    rewind(f);
+
+    // Never empty, so that a zero-length file still gets a buffer of its own
+    buf = malloc(len + 1);
+    if (!buf || fread(buf, 1, len, f) != (size_t)len) {
+        fprintf(stderr, "%s: read failed\n", path);
+        fclose(f);
+        free(buf);
+        return NULL;
+    }
+    fclose(f);
+
+    *size = len;
+    return buf;
+}
+
+/*
+ * Frequencies in v2 headers are packed LSB first with a prefix code: 00 is 0, 10 is 1, x01 is
+ * 2 + x, xx011 is 4 + xx, then 0111 and 1111 are followed by 4 and 10 bits of value - 8 and
+ * value - 24.
+ */
+static unsigned int unpack_freq(uint64_t b, int *nbits)
+{
+    if (!(b & 1)) {
+        *nbits = 2;
+        return (b >> 1) & 1;
+    }
+    if (!(b & 2)) {
+        *nbits = 3;
+        return 2 + ((b >> 2) & 1);
+    }
+    if (!(b & 4)) {
+        *nbits = 5;
+        return 4 + ((b >> 3) & 3);
+    }
+    if (!(b & 8)) {
+        *nbits = 8;
+        return 8 + ((b >> 4) & 0xf);
+    }
+    *nbits = 14;
+    return 24 + ((b >> 4) & 0x3ff);
+}
+
+// Rewrites a v2 block header as a v1 one, returning the length of the v2 header
+static size_t expand_v2(const uint8_t *p, struct v1_header *h)
+{
+    uint64_t v0 = le64(p + 8), v1 = le64(p + 16), v2 = le64(p + 24);
+    size_t header_len = field(v2, 0, 32);
+    const uint8_t *q = p + V2_HEADER_LEN, *end = p + header_len;
+    uint64_t accum = 0;
+    int accum_nbits = 0;
+
+    memset(h, 0, sizeof(*h));
+    h->magic = MAGIC_V1;
+    h->n_raw_bytes = le32(p + 4);
+    h->n_literals = field(v0, 0, 20);
+    h->n_literal_payload_bytes = field(v0, 20, 20);
+    h->n_matches = field(v0, 40, 20);
+    h->literal_bits = (int)field(v0, 60, 3) - 7;
+    for (int i = 0; i < 4; i++)
+        h->literal_state[i] = field(v1, 10 * i, 10);
+    h->n_lmd_payload_bytes = field(v1, 40, 20);
+    h->lmd_bits = (int)field(v1, 60, 3) - 7;
+    h->l_state = field(v2, 32, 10);
+    h->m_state = field(v2, 42, 10);
+    h->d_state = field(v2, 52, 10);
+    h->n_payload_bytes = h->n_literal_payload_bytes + h->n_lmd_payload_bytes;
+
+    if (q == end)
+        return header_len;
+
+    for (int i = 0; i < N_FREQS; i++) {
+        int nbits;
+
+        while (q < end && accum_nbits <= 56) {
+            accum |= (uint64_t)*q++ << accum_nbits;
+            accum_nbits += 8;
+        }
+        h->freq[i] = unpack_freq(accum, &nbits);
+        accum >>= nbits;
+        accum_nbits -= nbits;
+    }
+
+    return header_len;
+}
+
+/*
+ * Walks the blocks of a stream, counting them by type in counts if set. With out set, also writes
+ * a copy of the stream with v2 headers expanded to v1 ones there. Returns the number of v2
+ * blocks, or -1 if the stream is malformed.
+ */
+static int walk(const uint8_t *in, size_t in_size, unsigned long *counts, uint8_t *out,
+                size_t *out_size)
+{
+    unsigned long dummy[BLOCK_TYPES] = {0};
+    const uint8_t *p = in, *end = in + in_size;
+    int n_v2 = 0;
+
+    if (!counts)
+        counts = dummy;
+
+    if (out_size)
+        *out_size = 0;
+
+    while (end - p >= 4) {
+        uint32_t magic = le32(p);
+        size_t len, header_len;
+        struct v1_header h;
+
+        switch (magic) {
+            case MAGIC_END:
+                if (out) {
+                    memcpy(out + *out_size, p, 4);
+                    *out_size += 4;
+                }
+                return p + 4 == end ? n_v2 : -1;
+            case MAGIC_RAW:
+                if (end - p < 8)
+                    return -1;
+                len = 8 + (size_t)le32(p + 4);
+                counts[BLOCK_RAW]++;
+                break;
+            case MAGIC_LZVN:
+                if (end - p < 12)
+                    return -1;
+                len = 12 + (size_t)le32(p + 8);
+                counts[BLOCK_LZVN]++;
+                break;
+            case MAGIC_V1:
+                if ((size_t)(end - p) < sizeof(h))
+                    return -1;
+                memcpy(&h, p, sizeof(h));
+                len = sizeof(h) + (size_t)h.n_payload_bytes;
+                counts[BLOCK_V1]++;
+                break;
+            case MAGIC_V2:
+                if (end - p < V2_HEADER_LEN || field(le64(p + 24), 0, 32) > (size_t)(end - p))
+                    return -1;
+                header_len = expand_v2(p, &h);
+                if (header_len < V2_HEADER_LEN)
+                    return -1;
+                len = header_len + h.n_payload_bytes;
+                if (len > (size_t)(end - p))
+                    return -1;
+                counts[BLOCK_V2]++;
+                n_v2++;
+                if (out) {
+                    memcpy(out + *out_size, &h, sizeof(h));
+                    memcpy(out + *out_size + sizeof(h), p + header_len, h.n_payload_bytes);
+                    *out_size += sizeof(h) + h.n_payload_bytes;
+                }
+                p += len;
+                continue;
+            default:
+                return -1;
+        }
+
+        if (len > (size_t)(end - p))
+            return -1;
+        if (out) {
+            memcpy(out + *out_size, p, len);
+            *out_size += len;
+        }
+        p += len;
+    }
+
+    return -1;
+}
+
+static bool guard_ok(const uint8_t *out, size_t size)
+{
+    for (size_t i = size; i < size + GUARD; i++) {
+        if (out[i] != FILL)
+            return false;
+    }
+
+    return true;
+}
+
+static void fail(const char *path, const char *what, size_t in_size, size_t out_size, int ret,
+                 size_t src_len, size_t dest_len)
+{
+    if (failures++ < 20)
+        printf("FAIL: %s: %s in=%zu out=%zu: ret %d, consumed %zu, produced %zu\n", path, what,
+               in_size, out_size, ret, src_len, dest_len);
+}
+
+/*
+ * Decodes the first in_size bytes of in, from a buffer of exactly that size so that overreads
+ * show up under ASan, into out_size bytes of out followed by a guard. With known set, the
+ * decoder is told the input size, otherwise it has to find the end on its own.
+ */
+static int decode(const uint8_t *in, size_t in_size, bool known, uint8_t *out, size_t out_size,
+                  size_t *src_len, size_t *dest_len)
+{
+    uint8_t *src = malloc(in_size ?: 1);
+    int ret;
+
+    memcpy(src, in, in_size);
+    memset(out, FILL, out_size + GUARD);
+    *src_len = known ? in_size : 0;
+    *dest_len = out_size;
+    ret = lzfse_decode(out, dest_len, src, src_len);
+    free(src);
+
+    return ret;
+}
+
+static void corrupt(uint8_t *buf, size_t size)
+{
+    int count = 1 + rng() % 4;
+
+    if (!size)
+        return;
+
+    while (count--) {
+        size_t pos = rng() % size;
+
+        if (rng() & 1)
+            buf[pos] ^= 1 << (rng() % 8);
+        else
+            buf[pos] = rng();
+    }
+}
+
+static void test_stream(const char *path, const uint8_t *in, size_t in_size, const uint8_t *ref,
+                        size_t ref_size, int iterations)
+{
+    uint8_t *out = malloc(ref_size + GUARD), *work = malloc(in_size ?: 1);
+    size_t src_len, dest_len, size;
+    int ret;
+
+    // Intact, with the input size known and unknown
+    for (int known = 0; known < 2; known++) {
+        ret = decode(in, in_size, known, out, ref_size, &src_len, &dest_len);
+        cases++;
+        if (ret || src_len != in_size || dest_len != ref_size || memcmp(out, ref, ref_size) ||
+            !guard_ok(out, ref_size))
+            fail(path, known ? "intact" : "intact, unknown size", in_size, ref_size, ret, src_len,
+                 dest_len);
+    }
+
+    // Any output buffer that is too small
+    for (int i = 0; i < iterations / 8 + 1 && ref_size; i++) {
+        size = i ? rng() % ref_size : ref_size - 1;
+        ret = decode(in, in_size, true, out, size, &src_len, &dest_len);
+        cases++;
+        if (ret != -LZFSE_ERR_NOSPACE || !guard_ok(out, size))
+            fail(path, "short output", in_size, size, ret, src_len, dest_len);
+    }
+
+    // Every stream ends in an end of stream block, so any truncation must be caught. A size of 0
+    // would tell the decoder that the size is unknown, so at least one byte is kept.
+    for (int i = 0; i < iterations / 4 + 1 && in_size > 1; i++) {
+        size = i ? 1 + rng() % (in_size - 1) : in_size - 1;
+        ret = decode(in, size, true, out, ref_size, &src_len, &dest_len);
+        cases++;
+        if (ret != -LZFSE_ERR_DATA || !guard_ok(out, ref_size))
+            fail(path, "truncated", size, ref_size, ret, src_len, dest_len);
+    }
+
+    // Corrupted input may still decode to something, but only within the buffers it was given
+    for (int i = 0; i < iterations; i++) {
+        memcpy(work, in, in_size);
+        corrupt(work, in_size);
+        size = rng() % 4 ? ref_size : rng() % (ref_size + 1);
+        ret = decode(work, in_size, true, out, size, &src_len, &dest_len);
+        cases++;
+        if ((ret && ret != -LZFSE_ERR_DATA && ret != -LZFSE_ERR_NOSPACE) ||
+            (!ret && (src_len > in_size || dest_len > size)) || !guard_ok(out, size))
+            fail(path, "corrupted", in_size, size, ret, src_len, dest_len);
+    }
+
+    free(work);
+    free(out);
+}
+
+static void test_file(const char *path, int iterations)
+{
+    size_t in_size, ref_size, len = strlen(path), v1_size;
+    uint8_t *in, *ref = NULL, *v1 = NULL;
+    char *ref_path;
+    int n_v2;
+
+    if (len < 6 || strcmp(path + len - 6, ".lzfse")) {
+        printf("FAIL: %s: not a .lzfse file\n", path);
+        failures++;
+        return;
+    }
+
+    ref_path = strndup(path, len - 6);
+    in = load(path, &in_size);
+    if (in)
+        ref = load(ref_path, &ref_size);
+    free(ref_path);
+    if (!ref) {
+        failures++;
+        free(in);
+        return;
+    }
+
+    n_v2 = walk(in, in_size, blocks, NULL, NULL);
+    if (n_v2 < 0) {
+        printf("FAIL: %s: malformed stream\n", path);
+        failures++;
+    } else {
+        test_stream(path, in, in_size, ref, ref_size, iterations);
+    }
+
+    if (n_v2 > 0) {
+        v1 = malloc(in_size + n_v2 * sizeof(struct v1_header));
+        walk(in, in_size, NULL, v1, &v1_size);
+        walk(v1, v1_size, blocks, NULL, NULL);
+        test_stream(path, v1, v1_size, ref, ref_size, iterations);
+    }
+
+    free(v1);
+    free(ref);
+    free(in);
+}
+
+int main(int argc, char **argv)
+{
+    int iterations = 200;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "n:s:")) != -1) {
+        switch (opt) {
+            case 'n':
+                iterations = atoi(optarg);
+                break;
+            case 's':
+                rng_state = strtoul(optarg, NULL, 0) ?: 1;
+                break;
+            default:
+                fprintf(stderr, "usage: %s [-n iterations] [-s seed] file.lzfse...\n", argv[0]);
+                return 2;
+        }
+    }
+
+    if (optind == argc) {
+        fprintf(stderr, "%s: no input files\n", argv[0]);
+        return 2;
+    }
+
+    for (int i = optind; i < argc; i++)
+        test_file(argv[i], iterations);
+
+    // The fixtures have to exercise every block type the decoder handles
+    for (int i = 0; i < BLOCK_TYPES; i++) {
+        if (!blocks[i]) {
+            printf("FAIL: no %s blocks in the test streams\n", block_names[i]);
+            failures++;
+        }
+    }
+
+    printf("lzfse_test: %lu cases, %u failures (blocks: %lu v1, %lu v2, %lu LZVN, %lu raw)\n",
+           cases, failures, blocks[BLOCK_V1], blocks[BLOCK_V2], blocks[BLOCK_LZVN],
+           blocks[BLOCK_RAW]);
+    return failures ? 1 : 0;
+}
@@ -0,0 +1,252 @@
+/* SPDX-License-Identifier: MIT */
+
+/*
+ * Host-side check of the minilzlib decoder in src/minilzlib against the decoder from before
+ * its hot-path rework (tools/minilzlib_ref, linked in as RefXzDecode). For each .xz file
+ * given, both decoders must agree on the result, the consumed and produced sizes, and every
+ * byte of the output buffer, for the intact stream and for randomly corrupted and truncated
+ * copies of it decoded into full and short buffers. With -b, also reports the decoding speed
+ * of both. Built and run by `make host-test` and `make host-bench`.
+ */
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "minilzlib/minlzma.h"
+
+#define GUARD        64
+#define FILL         0xa5
+#define BENCH_TIME_S 0.5
+
+bool RefXzDecode(uint8_t *InputBuffer, uint32_t *InputSize, uint8_t *OutputBuffer,
+                 uint32_t *OutputSize);
+
+typedef bool xz_decode_func(uint8_t *, uint32_t *, uint8_t *, uint32_t *);
+
+struct result {
+    bool ok;
+    uint32_t in_size;
+    uint32_t out_size;
+};
+
+static unsigned int failures;
+static unsigned long cases;
+
+static uint32_t rng_state = 0x12345678;
+
+// Both decoders yield to the m1n1 run-loop between LZMA2 chunks and report errors on the console
+void sched_yield(void)
+{
+}
+
+int debug_printf(const char *fmt, ...)
+{
+    (void)fmt;
+    return 0;
+}
+
+static uint32_t rng(void)
+{
+    rng_state ^= rng_state << 13;
+    rng_state ^= rng_state >> 17;
+    rng_state ^= rng_state << 5;
+    return rng_state;
+}
+
+static double now(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static uint8_t *load(const char *path, uint32_t *size)
+{
+    FILE *f = fopen(path, "rb");
+    uint8_t *buf;
+    long len;
+
+    if (!f) {
+        perror(path);
+        return NULL;
+    }
+
+    fseek(f, 0, SEEK_END);
+    len = ftell(f);
+    rewind(f);
+
+    buf = malloc(len + GUARD);
+    if (!buf || fread(buf, 1, len, f) != (size_t)len) {
+        fprintf(stderr, "%s: read failed\n", path);
+        fclose(f);
+        free(buf);
+        return NULL;
+    }
+    fclose(f);
+
+    memset(buf + len, 0, GUARD);
+    *size = len;
+    return buf;
+}
+
+static struct result decode(xz_decode_func *func, uint8_t *in, uint32_t in_size, uint8_t *out,
+                            uint32_t out_size)
+{
+    struct result r;
+
+    memset(out, FILL, out_size + GUARD);
+    r.in_size = in_size;
+    r.out_size = out_size;
+    r.ok = func(in, &r.in_size, out, &r.out_size);
+    return r;
+}
+
+static void compare(const char *path, const char *what, uint8_t *in, uint32_t in_size,
+                    uint8_t *ref_out, uint8_t *out, uint32_t out_size)
+{
+    struct result ref = decode(RefXzDecode, in, in_size, ref_out, out_size);
+    struct result cur = decode(XzDecode, in, in_size, out, out_size);
+
+    cases++;
+    if (ref.ok == cur.ok && ref.in_size == cur.in_size && ref.out_size == cur.out_size &&
+        !memcmp(ref_out, out, out_size + GUARD))
+        return;
+
+    if (failures++ < 20)
+        printf("FAIL: %s: %s in=%u out=%u: ref %d/%u/%u, new %d/%u/%u\n", path, what, in_size,
+               out_size, ref.ok, ref.in_size, ref.out_size, cur.ok, cur.in_size, cur.out_size);
+}
+
+static void corrupt(uint8_t *buf, uint32_t size)
+{
+    int count = 1 + rng() % 4;
+
+    if (!size)
+        return;
+
+    while (count--) {
+        uint32_t pos = rng() % size;
+
+        if (rng() & 1)
+            buf[pos] ^= 1 << (rng() % 8);
+        else
+            buf[pos] = rng();
+    }
+}
+
+static double bench(xz_decode_func *func, uint8_t *in, uint32_t in_size, uint8_t *out,
+                    uint32_t out_size)
+{
+    double start = now(), elapsed;
+    unsigned long bytes = 0;
+
+    do {
+        uint32_t in_len = in_size, out_len = out_size;
+
+        func(in, &in_len, out, &out_len);
+        bytes += out_len;
+        elapsed = now() - start;
+    } while (elapsed < BENCH_TIME_S);
+
+    return bytes / elapsed / 1e6;
+}
+
+static void test_file(const char *path, int iterations, bool benchmark)
+{
+    uint32_t in_size, out_size = 0, size = 0;
+    uint8_t *in, *work, *ref_out, *out;
+    struct result r;
+
+    in = load(path, &in_size);
+    if (!in) {
+        failures++;
+        return;
+    }
+
+    // Size query: no output buffer
+    r.in_size = in_size;
+    r.ok = RefXzDecode(in, &r.in_size, NULL, &size);
+    r.in_size = in_size;
+    if (r.ok != XzDecode(in, &r.in_size, NULL, &out_size) || size != out_size) {
+        printf("FAIL: %s: size query\n", path);
+        failures++;
+    }
+    cases++;
+
+    work = malloc(in_size + GUARD);
+    ref_out = malloc(out_size + GUARD);
+    out = malloc(out_size + GUARD);
+
+    compare(path, "intact", in, in_size, ref_out, out, out_size);
+    if (out_size)
+        compare(path, "short output", in, in_size, ref_out, out, rng() % out_size);
+
+    for (int i = 0; i < iterations; i++) {
+        uint32_t len = in_size;
+
+        memcpy(work, in, in_size + GUARD);
+        if (rng() % 4)
+            corrupt(work, in_size);
+        else if (in_size)
+            len = rng() % in_size;
+
+        compare(path, "corrupted", work, len, ref_out, out, out_size);
+        if (out_size && !(rng() % 4))
+            compare(path, "corrupted, short output", work, len, ref_out, out, rng() % out_size);
+    }
+
+    if (benchmark && out_size) {
+        double ref_rate = bench(RefXzDecode, in, in_size, ref_out, out_size);
+        double rate = bench(XzDecode, in, in_size, out, out_size);
+
+        printf("%-40s %9u -> %9u: ref %8.1f MB/s, new %8.1f MB/s (%.2fx)\n", path, in_size,
+               out_size, ref_rate, rate, rate / ref_rate);
+    }
+
+    free(out);
+    free(ref_out);
+    free(work);
+    free(in);
+}
+
+int main(int argc, char **argv)
+{
+    bool benchmark = false;
+    int iterations = 200;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "bn:s:")) != -1) {
+        switch (opt) {
+            case 'b':
+                benchmark = true;
+                break;
+            case 'n':
+                iterations = atoi(optarg);
+                break;
+            case 's':
+                rng_state = strtoul(optarg, NULL, 0) ?: 1;
+                break;
+            default:
+                fprintf(stderr, "usage: %s [-b] [-n iterations] [-s seed] file.xz...\n",
+                        argv[0]);
+                return 2;
+        }
+    }
+
+    if (optind == argc) {
+        fprintf(stderr, "%s: no input files\n", argv[0]);
+        return 2;
+    }
+
+    for (int i = optind; i < argc; i++)
+        test_file(argv[i], iterations, benchmark);
+
+    printf("minilzma_test: %lu cases, %u failures\n", cases, failures);
+    return failures ? 1 : 0;
+}